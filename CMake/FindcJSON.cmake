@@ -0,0 +1,73 @@
+# Find the cJSON library
+#
+# Input variables:
+#
+# - `CJSON_INCLUDE_DIR`:   The directory containing `cJSON.h`.
+# - `CJSON_LIBRARY`:       Path to the `cjson` library.
+#
+# Result variables:
+#
+# - `CJSON_FOUND`:         System has cJSON.
+# - `CJSON_INCLUDE_DIRS`:  The cJSON include directories.
+# - `CJSON_LIBRARIES`:     The cJSON library names.
+# - `CJSON_VERSION`:       Version of cJSON.
+#
+# Imported target:
+#
+# - `cJSON::cJSON`
+#
+# Distributions install the header as `cjson/cJSON.h`; the include directory
+# points inside it, so sources keep using `#include <cJSON.h>`.
+
+if(NOT DEFINED CJSON_INCLUDE_DIR AND
+   NOT DEFINED CJSON_LIBRARY)
+  find_package(PkgConfig QUIET)
+  if(PKG_CONFIG_FOUND)
+    pkg_check_modules(PC_CJSON QUIET "libcjson")
+  endif()
+endif()
+
+find_path(CJSON_INCLUDE_DIR "cJSON.h"
+  HINTS ${PC_CJSON_INCLUDE_DIRS}
+  PATH_SUFFIXES "cjson"
+)
+find_library(CJSON_LIBRARY NAMES "cjson"
+  HINTS ${PC_CJSON_LIBRARY_DIRS}
+)
+
+if(CJSON_INCLUDE_DIR AND EXISTS "${CJSON_INCLUDE_DIR}/cJSON.h")
+  file(STRINGS "${CJSON_INCLUDE_DIR}/cJSON.h" _cjson_version_lines
+    REGEX "#define[ \t]+CJSON_VERSION_(MAJOR|MINOR|PATCH)[ \t]+[0-9]+")
+  foreach(_part IN ITEMS MAJOR MINOR PATCH)
+    string(REGEX REPLACE ".*#define[ \t]+CJSON_VERSION_${_part}[ \t]+([0-9]+).*" "\\1"
+      _cjson_${_part} "${_cjson_version_lines}")
+  endforeach()
+  if(_cjson_MAJOR MATCHES "^[0-9]+$")
+    set(CJSON_VERSION "${_cjson_MAJOR}.${_cjson_MINOR}.${_cjson_PATCH}")
+  endif()
+  unset(_cjson_version_lines)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(cJSON
+  REQUIRED_VARS
+    CJSON_INCLUDE_DIR
+    CJSON_LIBRARY
+  VERSION_VAR
+    CJSON_VERSION
+)
+
+if(CJSON_FOUND)
+  set(CJSON_INCLUDE_DIRS ${CJSON_INCLUDE_DIR})
+  set(CJSON_LIBRARIES ${CJSON_LIBRARY})
+
+  if(NOT TARGET cJSON::cJSON)
+    add_library(cJSON::cJSON UNKNOWN IMPORTED)
+    set_target_properties(cJSON::cJSON PROPERTIES
+      IMPORTED_LOCATION "${CJSON_LIBRARY}"
+      INTERFACE_INCLUDE_DIRECTORIES "${CJSON_INCLUDE_DIR}"
+    )
+  endif()
+endif()
+
+mark_as_advanced(CJSON_INCLUDE_DIR CJSON_LIBRARY)
@@ -0,0 +1,165 @@
+// strdup при строгом -std=c11
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+#include "google_sheets.h"
+#include "gsheet_schema.h"
+
+// Фаззинг сборки тела записи: SheetRange -> JSON (gsheet_write_range) и
+// строки схемы -> JSON (gsheet_write_typed). Тело перехватывает подменный
+// транспорт, оно разбирается обратно и сравнивается с исходными ячейками.
+// Формат входа: первый байт - число столбцов (1 + b % 8), дальше ячейки,
+// разделённые '\n' ('\0' обрезает ячейку, как в C-строке)
+
+#define FUZZ_MAX_COLS 8
+
+static char* captured = NULL;   // последнее тело PUT
+
+static long fuzz_handler(void* user, const char* method, const char* url,
+                         const char* payload, const char** response, size_t* response_len) {
+    (void)user;
+    (void)method;
+    (void)url;
+    free(captured);
+    captured = payload ? strdup(payload) : NULL;
+    if (payload && !captured) abort();
+    *response = "{}";
+    *response_len = 2;
+    return 200;
+}
+
+#define FUZZ_FIELDS(X) \
+    X(STRING, text)    \
+    X(DOUBLE, number)  \
+    X(INT, count)      \
+    X(BOOL, flag)      \
+    X(DATE, ts)
+GSHEET_SCHEMA(FuzzRow, FUZZ_FIELDS)
+
+// values из тела: массив rows строк по cols ячеек
+static cJSON* captured_values(cJSON* root, size_t rows, size_t cols) {
+    cJSON* values = cJSON_GetObjectItem(root, "values");
+    if (!cJSON_IsArray(values) || (size_t)cJSON_GetArraySize(values) != rows) abort();
+    cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        if (!cJSON_IsArray(row) || (size_t)cJSON_GetArraySize(row) != cols) abort();
+    }
+    return values;
+}
+
+static void expect_number(const cJSON* cell, double expected) {
+    if (!isfinite(expected)) {
+        // NAN и бесконечность пишутся пустой ячейкой
+        if (!cJSON_IsString(cell) || cell->valuestring[0]) abort();
+    }
+    else if (!cJSON_IsNumber(cell) || cell->valuedouble != expected) {
+        abort();
+    }
+}
+
+static void check_range_payload(char*** table, size_t rows, size_t cols) {
+    cJSON* root = cJSON_Parse(captured);
+    if (!root) abort();
+    cJSON* values = captured_values(root, rows, cols);
+    size_t i = 0;
+    cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        size_t j = 0;
+        cJSON* cell = NULL;
+        cJSON_ArrayForEach(cell, row) {
+            if (!cJSON_IsString(cell) || strcmp(cell->valuestring, table[i][j]) != 0) abort();
+            j++;
+        }
+        i++;
+    }
+    cJSON_Delete(root);
+}
+
+static void check_typed_payload(const FuzzRow* records, size_t count) {
+    cJSON* root = cJSON_Parse(captured);
+    if (!root) abort();
+    cJSON* values = captured_values(root, count, 5);
+    size_t i = 0;
+    cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        const FuzzRow* record = &records[i++];
+        cJSON* cell = row->child;
+        if (!cJSON_IsString(cell) || strcmp(cell->valuestring, record->text) != 0) abort();
+        expect_number(cell = cell->next, record->number);
+        expect_number(cell = cell->next, record->count == GSHEET_INT_INVALID ? NAN : (double)record->count);
+        cell = cell->next;
+        if (!cJSON_IsBool(cell) || cJSON_IsTrue(cell) != (record->flag != 0)) abort();
+        expect_number(cell->next, (double)record->ts / 86400.0 + GSHEET_SERIAL_UNIX_EPOCH);
+    }
+    cJSON_Delete(root);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static GSheetClient* client = NULL;
+    if (!client) {
+        client = gsheet_init("fuzz", "fuzz");
+        if (!client || !gsheet_set_mock_transport(client, fuzz_handler, NULL)) abort();
+    }
+    if (size == 0) return 0;
+
+    // Ячейки - копия входа, '\n' заменяются на '\0'
+    const size_t cols = 1 + data[0] % FUZZ_MAX_COLS;
+    size_t cell_count = 1;
+    for (size_t k = 1; k < size; k++) cell_count += data[k] == '\n';
+    const size_t rows = (cell_count + cols - 1) / cols;
+    char* text = malloc(size);
+    char*** table = malloc(sizeof(char**) * rows + sizeof(char*) * rows * cols);
+    FuzzRow* records = malloc(sizeof(FuzzRow) * rows);
+    if (!text || !table || !records) {
+        free(text);
+        free(table);
+        free(records);
+        return 0;
+    }
+    memcpy(text, data + 1, size - 1);
+    text[size - 1] = '\0';
+
+    char** cells = (char**)(table + rows);
+    size_t cell = 0;
+    cells[cell++] = text;
+    for (size_t k = 0; k + 1 < size; k++) {
+        if (text[k] == '\n') {
+            text[k] = '\0';
+            cells[cell++] = text + k + 1;
+        }
+    }
+    while (cell < rows * cols) cells[cell++] = "";
+    for (size_t i = 0; i < rows; i++) {
+        table[i] = cells + i * cols;
+        // Поля схемы из ячеек строки: текст, число, целое, флаг, дата
+        const char* first = table[i][0];
+        const char* second = table[i][cols > 1 ? 1 : 0];
+        records[i].text = table[i][0];
+        records[i].number = strtod(first, NULL);
+        records[i].count = strtoll(second, NULL, 10);
+        records[i].flag = (unsigned char)first[0] & 1;
+        records[i].ts = (int64_t)strtoll(second, NULL, 16);
+    }
+
+    SheetRange range = { .data = table, .rows = rows, .cols = cols };
+    if (!gsheet_write_range(client, "Fuzz!A1", &range)) abort();
+    check_range_payload(table, rows, cols);
+
+    if (!FuzzRow_write(client, "Fuzz!A1", records, rows)) abort();
+    check_typed_payload(records, rows);
+
+    free(captured);
+    captured = NULL;
+    free(records);
+    free(table);
+    free(text);
+    return 0;
+}
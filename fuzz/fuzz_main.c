@@ -0,0 +1,153 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Драйвер харнессов без libFuzzer: AFL (afl-clang-fast / afl-gcc) и прогон из CTest
+//   fuzz_xxx                    - один вход из stdin
+//   fuzz_xxx file...            - каждый файл по разу (AFL: fuzz_xxx @@)
+//   fuzz_xxx -mutate=N seed...  - N детерминированных мутаций семян
+// Мутации: замена, вставка и удаление байта, обрезка, повтор куска
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+#define FUZZ_MAX_INPUT (1 << 20)
+#define FUZZ_MAX_GROWTH 256
+
+static uint8_t* read_stream(FILE* file, size_t* size) {
+    size_t cap = 4096, len = 0;
+    uint8_t* data = malloc(cap);
+    while (data) {
+        len += fread(data + len, 1, cap - len, file);
+        if (len < cap || cap >= FUZZ_MAX_INPUT) break;
+        uint8_t* grown = realloc(data, cap * 2);
+        if (!grown) {
+            free(data);
+            return NULL;
+        }
+        data = grown;
+        cap *= 2;
+    }
+    *size = len;
+    return data;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return NULL;
+    }
+    uint8_t* data = read_stream(file, size);
+    fclose(file);
+    return data;
+}
+
+// xorshift64: одинаковая последовательность мутаций на всех платформах
+static uint64_t fuzz_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static size_t mutate(uint8_t* data, size_t size, size_t cap, uint64_t* state) {
+    // Чаще всего меняются символы структуры JSON
+    static const char dictionary[] = "{}[]\",:\\0123456789.eE-+tfnul \n\x01\x7f\xc3\xff";
+    const int ops = 1 + (int)(fuzz_random(state) % 4);
+    for (int op = 0; op < ops; op++) {
+        const size_t at = size ? (size_t)(fuzz_random(state) % size) : 0;
+        const uint8_t byte = fuzz_random(state) % 2
+            ? (uint8_t)dictionary[fuzz_random(state) % (sizeof(dictionary) - 1)]
+            : (uint8_t)fuzz_random(state);
+        switch (fuzz_random(state) % 5) {
+        case 0:
+            if (size) data[at] = byte;
+            break;
+        case 1:
+            if (size < cap) {
+                memmove(data + at + 1, data + at, size - at);
+                data[at] = byte;
+                size++;
+            }
+            break;
+        case 2:
+            if (size) {
+                memmove(data + at, data + at + 1, size - at - 1);
+                size--;
+            }
+            break;
+        case 3:
+            size = at;
+            break;
+        default: {
+            const size_t len = size - at < 16 ? size - at : 16;
+            if (len && size + len <= cap) {
+                memmove(data + at + len, data + at, size - at);
+                size += len;
+            }
+            break;
+        }
+        }
+    }
+    return size;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        size_t size = 0;
+        uint8_t* data = read_stream(stdin, &size);
+        if (!data) return 1;
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+        return 0;
+    }
+
+    long iterations = 0;
+    int first = 1;
+    if (strncmp(argv[1], "-mutate=", 8) == 0) {
+        iterations = atol(argv[1] + 8);
+        first = 2;
+    }
+
+    int status = 0;
+    const int seeds = argc - first;
+    uint8_t** inputs = calloc(seeds ? (size_t)seeds : 1, sizeof(uint8_t*));
+    size_t* sizes = calloc(seeds ? (size_t)seeds : 1, sizeof(size_t));
+    if (!inputs || !sizes) return 1;
+    for (int i = 0; i < seeds; i++) {
+        inputs[i] = read_file(argv[first + i], &sizes[i]);
+        if (!inputs[i]) status = 1;
+        else LLVMFuzzerTestOneInput(inputs[i], sizes[i]);
+    }
+
+    if (iterations > 0 && seeds > 0 && status == 0) {
+        size_t cap = 0;
+        for (int i = 0; i < seeds; i++) {
+            if (sizes[i] > cap) cap = sizes[i];
+        }
+        cap += FUZZ_MAX_GROWTH;
+        uint8_t* buffer = malloc(cap);
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        for (long n = 0; buffer && n < iterations; n++) {
+            const int seed = (int)(fuzz_random(&state) % (uint64_t)seeds);
+            memcpy(buffer, inputs[seed], sizes[seed]);
+            const size_t size = mutate(buffer, sizes[seed], cap, &state);
+            // Копия точного размера: ASan видит чтение за концом входа
+            uint8_t* exact = malloc(size ? size : 1);
+            if (!exact) break;
+            memcpy(exact, buffer, size);
+            LLVMFuzzerTestOneInput(exact, size);
+            free(exact);
+        }
+        free(buffer);
+        printf("%ld mutated inputs from %d seed(s)\n", iterations, seeds);
+    }
+
+    for (int i = 0; i < seeds; i++) free(inputs[i]);
+    free(inputs);
+    free(sizes);
+    return status;
+}
@@ -0,0 +1,67 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "google_sheets.h"
+#include "gsheet_schema.h"
+
+// Фаззинг разбора ответа: JSON -> SheetRange (gsheet_read_range) и
+// JSON -> строки схемы (gsheet_read_typed). Вход отдаётся телом ответа 200
+// через подменный транспорт. Любой вход должен дать NULL или прямоугольную
+// таблицу без NULL-ячеек; остальное ловят ASan/UBSan.
+// Сборка: -DGSHEETS_FUZZ=ON (см. CMakeLists.txt), без libFuzzer - fuzz_main.c
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+} FuzzInput;
+
+static long fuzz_handler(void* user, const char* method, const char* url,
+                         const char* payload, const char** response, size_t* response_len) {
+    const FuzzInput* input = user;
+    (void)method;
+    (void)url;
+    (void)payload;
+    *response = (const char*)input->data;
+    *response_len = input->size;
+    return 200;
+}
+
+#define FUZZ_FIELDS(X) \
+    X(STRING, text)    \
+    X(DOUBLE, number)  \
+    X(INT, count)      \
+    X(BOOL, flag)      \
+    X(DATE, ts)
+GSHEET_SCHEMA(FuzzRow, FUZZ_FIELDS)
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static GSheetClient* client = NULL;
+    static FuzzInput input;
+    if (!client) {
+        client = gsheet_init("fuzz", "fuzz");
+        if (!client || !gsheet_set_mock_transport(client, fuzz_handler, &input)) abort();
+    }
+    input.data = data;
+    input.size = size;
+
+    SheetRange* range = gsheet_read_range(client, "Fuzz!A1:E");
+    if (range) {
+        if (range->rows && !range->data) abort();
+        size_t total = 0;
+        for (size_t i = 0; i < range->rows; i++) {
+            for (size_t j = 0; j < range->cols; j++) {
+                if (!range->data[i][j]) abort();
+                total += strlen(range->data[i][j]);
+            }
+        }
+        (void)total;
+        gsheet_free_range(range);
+    }
+
+    size_t count = 0;
+    FuzzRow* rows = FuzzRow_read(client, "Fuzz!A1:E", &count);
+    if (!rows && count) abort();
+    FuzzRow_free(client, rows, count);
+    return 0;
+}
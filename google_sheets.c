@@ -1,18 +1,41 @@
+// clock_gettime, nanosleep, strdup и strnlen при строгом -std=c11
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
 #include <curl/curl.h>
 #include <cJSON.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include "google_sheets.h"
+#include "gsheet_schema.h"
+
 
 // Объявляем прототипы функций для Windows
 #if defined(_WIN32) && !defined(strnlen)
 size_t strnlen(const char* s, size_t maxlen); 
 #endif
 
+#ifdef _WIN32
 char* strndup(const char* s, size_t n); // Явное объявление прототипа
+#endif
 
 // Реализация strnlen для Windows
 #if defined(_WIN32) && !defined(strnlen)
@@ -22,6 +45,7 @@ size_t strnlen(const char* s, size_t maxlen) {
 }
 #endif
 
+#ifdef _WIN32
 char* strndup(const char* s, size_t n) {
     size_t len = strnlen(s, n);
     char* new = malloc(len + 1);
@@ -31,24 +55,465 @@ char* strndup(const char* s, size_t n) {
     }
     return new;
 }
+#endif
+
+// Потоки и синхронизация: Win32 API или pthreads
+#ifdef _WIN32
+typedef HANDLE gsheet_thread_t;
+typedef CRITICAL_SECTION gsheet_mutex_t;
+typedef CONDITION_VARIABLE gsheet_cond_t;
+typedef INIT_ONCE gsheet_once_t;
+#define GSHEET_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_t gsheet_thread_t;
+typedef pthread_mutex_t gsheet_mutex_t;
+typedef pthread_cond_t gsheet_cond_t;
+typedef pthread_once_t gsheet_once_t;
+#define GSHEET_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+typedef struct {
+    void (*fn)(void*);
+    void* arg;
+} GSheetThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI gsheet_thread_entry(LPVOID param) {
+#else
+static void* gsheet_thread_entry(void* param) {
+#endif
+    GSheetThreadStart start = *(GSheetThreadStart*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+static int gsheet_thread_create(gsheet_thread_t* thread, void (*fn)(void*), void* arg) {
+    GSheetThreadStart* start = malloc(sizeof(GSheetThreadStart));
+    if (!start) return 0;
+    start->fn = fn;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, gsheet_thread_entry, start, 0, NULL);
+    if (*thread) return 1;
+#else
+    if (pthread_create(thread, NULL, gsheet_thread_entry, start) == 0) return 1;
+#endif
+    free(start);
+    return 0;
+}
+
+static void gsheet_thread_join(gsheet_thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static void gsheet_mutex_init(gsheet_mutex_t* mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void gsheet_mutex_destroy(gsheet_mutex_t* mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static void gsheet_mutex_lock(gsheet_mutex_t* mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static void gsheet_mutex_unlock(gsheet_mutex_t* mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static void gsheet_cond_init(gsheet_cond_t* cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static void gsheet_cond_destroy(gsheet_cond_t* cond) {
+#ifdef _WIN32
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+static void gsheet_cond_signal(gsheet_cond_t* cond) {
+#ifdef _WIN32
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+static void gsheet_cond_broadcast(gsheet_cond_t* cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+static void gsheet_cond_wait(gsheet_cond_t* cond, gsheet_mutex_t* mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+// Ожидание с таймаутом в миллисекундах
+static void gsheet_cond_timedwait(gsheet_cond_t* cond, gsheet_mutex_t* mutex, uint64_t timeout_ms) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, timeout_ms > 0xFFFFFFF0u ? 0xFFFFFFF0u : (DWORD)timeout_ms);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(timeout_ms / 1000);
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, mutex, &deadline);
+#endif
+}
+
+// Однократная инициализация на процесс
+#ifdef _WIN32
+typedef struct {
+    void (*fn)(void);
+} GSheetOnceCall;
+
+static BOOL CALLBACK gsheet_once_entry(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((GSheetOnceCall*)param)->fn();
+    return TRUE;
+}
+#endif
+
+static void gsheet_once(gsheet_once_t* once, void (*fn)(void)) {
+#ifdef _WIN32
+    GSheetOnceCall call = { fn };
+    InitOnceExecuteOnce(once, gsheet_once_entry, &call, NULL);
+#else
+    pthread_once(once, fn);
+#endif
+}
+
+// Монотонное время в микросекундах
+static uint64_t gsheet_now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000u
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000u / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+#endif
+}
+
+// Монотонное время в миллисекундах
+static uint64_t gsheet_now_ms(void) {
+    return gsheet_now_us() / 1000u;
+}
+
+static void gsheet_sleep_ms(uint64_t ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec delay;
+    delay.tv_sec = (time_t)(ms / 1000);
+    delay.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&delay, NULL);
+#endif
+}
+
+// Атомарные счётчики (relaxed): метрики пишутся из любых потоков без блокировок
+// Возвращает значение до прибавления
+static uint64_t gsheet_atomic_add(volatile uint64_t* target, uint64_t value) {
+#ifdef _MSC_VER
+    return (uint64_t)_InterlockedExchangeAdd64((volatile long long*)target, (long long)value);
+#else
+    return __atomic_fetch_add(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static uint64_t gsheet_atomic_load(const volatile uint64_t* target) {
+#ifdef _MSC_VER
+    return (uint64_t)_InterlockedCompareExchange64((volatile long long*)target, 0, 0);
+#else
+    return __atomic_load_n(target, __ATOMIC_RELAXED);
+#endif
+}
+
+static void gsheet_atomic_store(volatile uint64_t* target, uint64_t value) {
+#ifdef _MSC_VER
+    _InterlockedExchange64((volatile long long*)target, (long long)value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Захват флага: 1, если *target был равен expected и заменён на desired
+static int gsheet_atomic_cas(volatile uint64_t* target, uint64_t expected, uint64_t desired) {
+#ifdef _MSC_VER
+    return (uint64_t)_InterlockedCompareExchange64((volatile long long*)target,
+        (long long)desired, (long long)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#endif
+}
+
+// Метрики запросов
+typedef struct {
+    volatile uint64_t buckets[GSHEET_HISTOGRAM_BUCKETS];
+    volatile uint64_t count;
+    volatile uint64_t sum_us;
+} GSheetHistogram;
+
+typedef struct {
+    GSheetHistogram timers[GSHEET_TIMER_COUNT];
+    volatile uint64_t requests;
+    volatile uint64_t errors;
+    volatile uint64_t retries;
+    volatile uint64_t bytes_in;
+    volatile uint64_t bytes_out;
+    volatile uint64_t allocations;
+} GSheetMetrics;
+
+static void gsheet_histogram_observe(GSheetHistogram* histogram, uint64_t value_us) {
+    size_t bucket = 0;
+    while (bucket < GSHEET_HISTOGRAM_BUCKETS - 1 && ((uint64_t)1 << bucket) < value_us) {
+        bucket++;
+    }
+    gsheet_atomic_add(&histogram->buckets[bucket], 1);
+    gsheet_atomic_add(&histogram->count, 1);
+    gsheet_atomic_add(&histogram->sum_us, value_us);
+}
 
 // Структуры данных
+
+// Область действия аллокатора: чем выделять и где считать выделения
+typedef struct {
+    const GSheetAllocator* allocator;
+    volatile uint64_t* allocations;
+} GSheetAllocScope;
+
+// Аллокатор под мьютексом: пользовательский аллокатор (например, арена)
+// не обязан быть потокобезопасным, а пул потоков и шардированное чтение
+// обращаются к нему параллельно
 typedef struct {
+    const GSheetAllocator* inner;
+    gsheet_mutex_t mutex;
+} LockedAllocator;
+
+#define GSHEET_IDLE_CONNECTIONS 8
+
+typedef struct GSheetClient {
     char* access_token;
     char* spreadsheet_id;
+    GSheetMetrics metrics;
+    volatile uint64_t verbose;  // CURLOPT_VERBOSE, переключается в рантайме
+    int max_retries;            // повторы идемпотентных запросов при 429/5xx
+    GSheetAllocator allocator;
+    GSheetAllocScope alloc_scope;  // { &allocator, &metrics.allocations }
+    char* auth_header;          // "Authorization: Bearer ...", собирается один раз в gsheet_init
+    // Пул keep-alive соединений клиента
+    gsheet_mutex_t connection_mutex;
+    struct GSheetConnection* idle[GSHEET_IDLE_CONNECTIONS];
+    size_t idle_count;
+    // Аллокатор для параллельной работы (пул задач, шардированное чтение)
+    LockedAllocator locked;
+    GSheetAllocator locked_allocator;
+    GSheetAllocScope shared_scope;
+    struct GSheetPool* pool;    // пул задач для *_async или NULL
+    // Общий HTTP/2-транспорт нескольких клиентов или NULL (свои соединения)
+    struct GSheetTransport* transport;
+    struct TransportTenant* tenant;
+    // Подменный транспорт вместо сети (тесты, фаззинг, прогон для PGO) или NULL
+    struct GSheetMock* mock;
 } GSheetClient;
 
+#ifdef _MSC_VER
+#define GSHEET_THREAD_LOCAL __declspec(thread)
+#else
+#define GSHEET_THREAD_LOCAL _Thread_local
+#endif
+
+// Аллокатор, действующий в текущем потоке. cJSON_InitHooks глобален,
+// поэтому хуки cJSON и колбэки curl берут аллокатор отсюда
+static GSHEET_THREAD_LOCAL const GSheetAllocScope* alloc_scope = NULL;
+
+static const GSheetAllocScope* gsheet_alloc_enter(const GSheetAllocScope* scope) {
+    const GSheetAllocScope* previous = alloc_scope;
+    alloc_scope = scope;
+    return previous;
+}
+
+static void gsheet_alloc_leave(const GSheetAllocScope* previous) {
+    alloc_scope = previous;
+}
+
+static void* allocator_malloc(const GSheetAllocator* allocator, size_t size) {
+    return allocator->malloc_fn ? allocator->malloc_fn(allocator->ctx, size) : malloc(size);
+}
+
+static void* allocator_realloc(const GSheetAllocator* allocator, void* ptr, size_t size) {
+    return allocator->realloc_fn ? allocator->realloc_fn(allocator->ctx, ptr, size) : realloc(ptr, size);
+}
+
+static void allocator_free(const GSheetAllocator* allocator, void* ptr) {
+    if (!ptr) return;
+    if (allocator->free_fn) allocator->free_fn(allocator->ctx, ptr);
+    else free(ptr);
+}
+
+
+static void* locked_malloc(void* ctx, size_t size) {
+    LockedAllocator* locked = ctx;
+    gsheet_mutex_lock(&locked->mutex);
+    void* ptr = allocator_malloc(locked->inner, size);
+    gsheet_mutex_unlock(&locked->mutex);
+    return ptr;
+}
+
+static void* locked_realloc(void* ctx, void* ptr, size_t size) {
+    LockedAllocator* locked = ctx;
+    gsheet_mutex_lock(&locked->mutex);
+    void* result = allocator_realloc(locked->inner, ptr, size);
+    gsheet_mutex_unlock(&locked->mutex);
+    return result;
+}
+
+static void locked_free(void* ctx, void* ptr) {
+    LockedAllocator* locked = ctx;
+    gsheet_mutex_lock(&locked->mutex);
+    allocator_free(locked->inner, ptr);
+    gsheet_mutex_unlock(&locked->mutex);
+}
+
+// Вне вызовов библиотеки - хуки приложения (gsheet_set_cjson_hooks)
+static void* (*fallback_malloc)(size_t size) = malloc;
+static void (*fallback_free)(void* ptr) = free;
+
+static void* gsheet_malloc(size_t size) {
+    const GSheetAllocScope* scope = alloc_scope;
+    if (!scope) return fallback_malloc(size);
+    gsheet_atomic_add(scope->allocations, 1);
+    return allocator_malloc(scope->allocator, size);
+}
+
+static void* gsheet_realloc(void* ptr, size_t size) {
+    const GSheetAllocScope* scope = alloc_scope;
+    if (!scope) return realloc(ptr, size);    // cJSON сам realloc не зовёт, библиотека - только в области
+    gsheet_atomic_add(scope->allocations, 1);
+    return allocator_realloc(scope->allocator, ptr, size);
+}
+
+static void gsheet_mem_free(void* ptr) {
+    const GSheetAllocScope* scope = alloc_scope;
+    if (!scope) fallback_free(ptr);
+    else allocator_free(scope->allocator, ptr);
+}
+
+static char* gsheet_strndup(const char* s, size_t n) {
+    size_t len = strnlen(s, n);
+    char* copy = gsheet_malloc(len + 1);
+    if (copy) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+static char* gsheet_strdup(const char* s) {
+    return gsheet_strndup(s, strlen(s));
+}
+
+// Буфер приёма ответа. Живёт вместе с соединением и переиспользуется между
+// запросами, поэтому выделяется обычным malloc, а не аллокатором клиента
+// (сброс арены между запросами его бы уничтожил)
 typedef struct {
-    char*** data;
-    size_t rows;
-    size_t cols;
-} SheetRange;
+    char* data;
+    size_t len;
+    size_t cap;
+} GSheetBuffer;
+
+// Соединение: curl-хендл (держит keep-alive, DNS и TLS-сессии), буфер ответа
+// и готовые списки заголовков. Клиент держит одно такое соединение в пуле
+typedef struct GSheetConnection {
+    CURL* curl;
+    GSheetBuffer body;
+    struct curl_slist* headers;       // авторизация
+    struct curl_slist* json_headers;  // авторизация + Content-Type
+    CURLSH* share;                    // общие DNS/TLS-кэши нескольких соединений или NULL
+} GSheetConnection;
+
+// Резерв под len байт + завершающий '\0'; ёмкость растёт геометрически
+static int buffer_reserve(GSheetBuffer* buffer, size_t len) {
+    if (len + 1 <= buffer->cap) return 1;
+    size_t cap = buffer->cap ? buffer->cap : 4096;
+    while (cap < len + 1) cap *= 2;
+    char* data = realloc(buffer->data, cap);
+    if (!data) return 0;
+    buffer->data = data;
+    buffer->cap = cap;
+    return 1;
+}
 
 // Вспомогательные функции
 static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    char** response = (char**)userdata;
-    *response = strndup(ptr, size * nmemb);
-    return size * nmemb;
+    GSheetBuffer* body = (GSheetBuffer*)userdata;
+    const size_t chunk = size * nmemb;
+    if (!buffer_reserve(body, body->len + chunk)) return 0;
+    memcpy(body->data + body->len, ptr, chunk);
+    body->len += chunk;
+    body->data[body->len] = '\0';
+    return chunk;
+}
+
+// По Content-Length выделяем буфер сразу нужного размера
+static size_t header_callback(char* ptr, size_t size, size_t nitems, void* userdata) {
+    static const char content_length[] = "content-length:";
+    GSheetBuffer* body = (GSheetBuffer*)userdata;
+    const size_t len = size * nitems;
+
+    if (len > sizeof(content_length) - 1) {
+        size_t i = 0;
+        while (i < sizeof(content_length) - 1 && (ptr[i] | 0x20) == content_length[i]) i++;
+        if (i == sizeof(content_length) - 1) {
+            unsigned long long hint = strtoull(ptr + i, NULL, 10);
+            if (hint > 0 && hint < ((size_t)1 << 31)) buffer_reserve(body, body->len + (size_t)hint);
+        }
+    }
+    return len;
 }
 
 // static char* build_auth_header(GSheetClient* client) {
@@ -65,19 +530,69 @@ static char* build_auth_header(GSheetClient* client) {
     return header;
 }
 
-// Вспомогательная функция. Выводим спарсенные данные
-static void print_data_from_gsheet(SheetRange* data, const char* range) {
-    printf("Data from range %s:\n", range);
-    for (size_t i = 0; i < data->rows; i++) {
-        for (size_t j = 0; j < data->cols; j++) {
-            printf("%-20s", data->data[i][j]);
-        }
-        printf("\n");
+// Вспомогательная функция. Снимает тайминги и объём трафика после curl_easy_perform
+static void gsheet_record_request(GSheetClient* client, CURL* curl, CURLcode res, long http_code) {
+    GSheetMetrics* metrics = &client->metrics;
+    curl_off_t dns = 0, connect = 0, tls = 0, ttfb = 0, total = 0;
+    curl_off_t downloaded = 0, uploaded = 0;
+
+    // Все *_TIME_T отсчитываются от начала запроса, в микросекундах
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+
+    gsheet_atomic_add(&metrics->requests, 1);
+    if (res != CURLE_OK || http_code >= 400) {
+        gsheet_atomic_add(&metrics->errors, 1);
+    }
+    gsheet_atomic_add(&metrics->bytes_in, (uint64_t)downloaded);
+    gsheet_atomic_add(&metrics->bytes_out, (uint64_t)uploaded);
+
+    gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_DNS], (uint64_t)dns);
+    gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_CONNECT],
+        connect > dns ? (uint64_t)(connect - dns) : 0);
+    // APPCONNECT == 0, если TLS не было (переиспользованное соединение)
+    if (tls > connect) {
+        gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_TLS], (uint64_t)(tls - connect));
+    }
+    gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_TTFB], (uint64_t)ttfb);
+    gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_TOTAL], (uint64_t)total);
+}
+
+// Общий транспорт (раздел 27)
+static CURLcode gsheet_transport_perform(GSheetClient* client, CURL* curl);
+
+// Повторяем только временные ошибки
+static int gsheet_is_retryable(CURLcode res, long http_code) {
+    if (res == CURLE_OPERATION_TIMEDOUT || res == CURLE_COULDNT_CONNECT || res == CURLE_RECV_ERROR) {
+        return 1;
     }
+    return http_code == 429 || http_code == 500 || http_code == 502 || http_code == 503 || http_code == 504;
+}
+
+static void gsheet_connection_free(GSheetConnection* connection) {
+    if (!connection) return;
+    if (connection->curl) curl_easy_cleanup(connection->curl);
+    curl_slist_free_all(connection->headers);
+    curl_slist_free_all(connection->json_headers);
+    free(connection->body.data);
+    free(connection);
 }
 
 void gsheet_free(GSheetClient* client) {
     if (!client) return;
+    gsheet_attach_transport(client, NULL);
+    for (size_t i = 0; i < client->idle_count; i++) {
+        gsheet_connection_free(client->idle[i]);
+    }
+    gsheet_mutex_destroy(&client->connection_mutex);
+    gsheet_mutex_destroy(&client->locked.mutex);
+    free(client->mock);
+    free(client->auth_header);
     free(client->access_token);
     free(client->spreadsheet_id);
     free(client);
@@ -85,63 +600,210 @@ void gsheet_free(GSheetClient* client) {
 
 void gsheet_free_range(SheetRange* range) {
     if (!range) return;
+    const GSheetAllocator allocator = range->allocator;
     for (size_t i = 0; i < range->rows; i++) {
         for (size_t j = 0; j < range->cols; j++) {
-            free(range->data[i][j]);
+            allocator_free(&allocator, range->data[i][j]);
         }
-        free(range->data[i]);
+        if (!range->row_block) allocator_free(&allocator, range->data[i]);
     }
-    free(range->data);
-    free(range);
+    allocator_free(&allocator, range->data);
+    allocator_free(&allocator, range);
+}
+
+// Хуки cJSON на процесс
+static gsheet_once_t cjson_hooks_once = GSHEET_ONCE_INIT;
+
+static void install_cjson_hooks(void) {
+    static cJSON_Hooks hooks = { gsheet_malloc, gsheet_mem_free };
+    cJSON_InitHooks(&hooks);
 }
 
 // Основные методы
 // 1. Initialization of client
 GSheetClient* gsheet_init(const char* access_token, const char* spreadsheet_id) {
-    GSheetClient* client = malloc(sizeof(GSheetClient));
+    GSheetClient* client = calloc(1, sizeof(GSheetClient));
+    if (!client) return NULL;
     client->access_token = strdup(access_token);
     client->spreadsheet_id = strdup(spreadsheet_id);
+    client->max_retries = 2;
+    client->alloc_scope.allocator = &client->allocator;
+    client->alloc_scope.allocations = &client->metrics.allocations;
+    client->locked.inner = &client->allocator;
+    gsheet_mutex_init(&client->locked.mutex);
+    client->locked_allocator.malloc_fn = locked_malloc;
+    client->locked_allocator.realloc_fn = locked_realloc;
+    client->locked_allocator.free_fn = locked_free;
+    client->locked_allocator.ctx = &client->locked;
+    client->shared_scope = client->alloc_scope;
+    gsheet_mutex_init(&client->connection_mutex);
+    client->auth_header = build_auth_header(client);
+
+    // Хуки ставятся один раз на процесс: без активного клиента это malloc/free
+    // или функции из gsheet_set_cjson_hooks.
+    // cJSON_InitHooks переписывает глобальную таблицу, поэтому повторный вызов
+    // из gsheet_init мог бы пересечься с разбором в потоках других клиентов
+    gsheet_once(&cjson_hooks_once, install_cjson_hooks);
     return client;
 }
 
-// 2. read gsheet in specified range
-SheetRange* gsheet_read_range(GSheetClient* client, const char* range) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
+static GSheetConnection* gsheet_connection_create(GSheetClient* client) {
+    GSheetConnection* connection = calloc(1, sizeof(GSheetConnection));
+    if (!connection) return NULL;
+    connection->curl = curl_easy_init();
+    connection->headers = curl_slist_append(NULL, client->auth_header);
+    connection->json_headers = curl_slist_append(NULL, client->auth_header);
+    connection->json_headers = curl_slist_append(connection->json_headers, "Content-Type: application/json");
+    if (!connection->curl || !connection->headers || !connection->json_headers) {
         fprintf(stderr, "Failed to initialize CURL\n");
+        gsheet_connection_free(connection);
         return NULL;
     }
+    return connection;
+}
 
-    char* response = NULL;
-    long http_code = 0;
+// Берём свободное соединение из пула клиента или создаём новое
+static GSheetConnection* gsheet_connection_acquire(GSheetClient* client) {
+    GSheetConnection* connection = NULL;
+    gsheet_mutex_lock(&client->connection_mutex);
+    if (client->idle_count > 0) {
+        connection = client->idle[--client->idle_count];
+    }
+    gsheet_mutex_unlock(&client->connection_mutex);
+    return connection ? connection : gsheet_connection_create(client);
+}
+
+// Возвращаем соединение в пул; сверх GSHEET_IDLE_CONNECTIONS - закрываем
+static void gsheet_connection_release(GSheetClient* client, GSheetConnection* connection) {
+    if (!connection) return;
+    gsheet_mutex_lock(&client->connection_mutex);
+    if (client->idle_count < GSHEET_IDLE_CONNECTIONS) {
+        client->idle[client->idle_count++] = connection;
+        connection = NULL;
+    }
+    gsheet_mutex_unlock(&client->connection_mutex);
+    gsheet_connection_free(connection);
+}
+
+// Подменный транспорт (GSheetMockHandler)
+typedef struct GSheetMock {
+    GSheetMockHandler handler;
+    void* user;
+} GSheetMock;
+
+// Подключение (handler != NULL) или отключение подменного транспорта.
+// Вызывать, пока у клиента нет запросов в работе
+bool gsheet_set_mock_transport(GSheetClient* client, GSheetMockHandler handler, void* user) {
+    if (!client) return false;
+    GSheetMock* mock = NULL;
+    if (handler) {
+        mock = malloc(sizeof(GSheetMock));
+        if (!mock) {
+            fprintf(stderr, "Out of memory while attaching mock transport\n");
+            return false;
+        }
+        mock->handler = handler;
+        mock->user = user;
+    }
+    free(client->mock);
+    client->mock = mock;
+    return true;
+}
+
+// Вспомогательная функция. Запрос через подменный транспорт: без повторов,
+// метрики - только счётчики и TOTAL
+static CURLcode gsheet_mock_request(GSheetClient* client, GSheetConnection* connection,
+                                    const char* method, const char* url, const char* payload, long* http_code) {
+    GSheetMetrics* metrics = &client->metrics;
+    const char* response = NULL;
+    size_t response_len = 0;
     CURLcode res = CURLE_OK;
-    char url[1024];
-    struct curl_slist* headers = NULL;
 
-    // Формирование URL
-    snprintf(url, sizeof(url), 
-        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s",
-        client->spreadsheet_id, range);
+    connection->body.len = 0;
+    if (connection->body.data) connection->body.data[0] = '\0';
+    uint64_t start = gsheet_now_us();
+    *http_code = client->mock->handler(client->mock->user, method, url, payload, &response, &response_len);
+    if (*http_code == 0) {
+        res = CURLE_COULDNT_CONNECT;
+    }
+    else if (response && response_len) {
+        if (!buffer_reserve(&connection->body, response_len)) {
+            res = CURLE_OUT_OF_MEMORY;
+        }
+        else {
+            memcpy(connection->body.data, response, response_len);
+            connection->body.len = response_len;
+            connection->body.data[response_len] = '\0';
+        }
+    }
+
+    gsheet_atomic_add(&metrics->requests, 1);
+    if (res != CURLE_OK || *http_code >= 400) {
+        gsheet_atomic_add(&metrics->errors, 1);
+    }
+    gsheet_atomic_add(&metrics->bytes_in, (uint64_t)connection->body.len);
+    gsheet_atomic_add(&metrics->bytes_out, payload ? (uint64_t)strlen(payload) : 0);
+    gsheet_histogram_observe(&metrics->timers[GSHEET_TIMER_TOTAL], gsheet_now_us() - start);
+    return res;
+}
+
+// Вспомогательная функция. HTTP-запрос с авторизацией, тело ответа - в connection->body
+// method: "GET", "PUT" или "POST"; payload - JSON или NULL
+static CURLcode gsheet_http_request(GSheetClient* client, GSheetConnection* connection,
+                                   const char* method, const char* url, const char* payload, long* http_code) {
+    CURL* curl = connection->curl;
+    CURLcode res = CURLE_OK;
+    const int is_get = strcmp(method, "GET") == 0;
+    *http_code = 0;
+
+    if (client->mock) {
+        return gsheet_mock_request(client, connection, method, url, payload, http_code);
+    }
+
+    // reset сбрасывает опции, но сохраняет открытые соединения и кэши
+    curl_easy_reset(curl);
 
-    // Установка заголовков
-    headers = curl_slist_append(headers, build_auth_header(client));
-    
     // Настройка параметров CURL
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, payload ? connection->json_headers : connection->headers);
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L); // Включить подробное логирование
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &connection->body);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &connection->body);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, gsheet_atomic_load(&client->verbose) ? 1L : 0L);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L); // Таймаут 10 секунд
     // Отключаем для проверки без SSL
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+    if (payload) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
+    }
+    if (!is_get) {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    }
+    if (connection->share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, connection->share);
+    }
+    if (client->transport) {
+        // Ждём свободный поток в существующем HTTP/2-соединении вместо нового
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
 
-    // Выполнение запроса
-    res = curl_easy_perform(curl);
-    
-    // Получение HTTP-статуса
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    // Выполнение запроса (GET идемпотентен, временные ошибки повторяем с backoff)
+    for (int attempt = 0; ; attempt++) {
+        connection->body.len = 0;
+        if (connection->body.data) connection->body.data[0] = '\0';
+        res = client->transport ? gsheet_transport_perform(client, curl) : curl_easy_perform(curl);
+
+        // Получение HTTP-статуса
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
+        gsheet_record_request(client, curl, res, *http_code);
+
+        if (!is_get || attempt >= client->max_retries || !gsheet_is_retryable(res, *http_code)) break;
+        gsheet_atomic_add(&client->metrics.retries, 1);
+        gsheet_sleep_ms((uint64_t)100 << attempt);
+    }
 
     // Расширенная диагностика
     if (res != CURLE_OK) {
@@ -157,96 +819,179 @@ SheetRange* gsheet_read_range(GSheetClient* client, const char* range) {
     }
 
     // Обработка HTTP-статусов
-    if (http_code != 200 && http_code != 0) {
-        fprintf(stderr, "HTTP Error: %ld\n", http_code);
-        if (response) fprintf(stderr, "Response: %s\n", response);
+    if (*http_code != 200 && *http_code != 0) {
+        fprintf(stderr, "HTTP Error: %ld\n", *http_code);
+        if (connection->body.len) fprintf(stderr, "Response: %s\n", connection->body.data);
     }
 
-    SheetRange* result = NULL;
-    if (res == CURLE_OK && http_code == 200 && response) {
+    return res;
+}
 
-        // Парсинг ответа
-        cJSON* root = cJSON_Parse(response);
-        if (!root) {
-            fprintf(stderr, "Failed to parse JSON response\n");
-        }
-        else {
-            cJSON* values = cJSON_GetObjectItem(root, "values");
-            if (!values) {
-                fprintf(stderr, "No 'values' field in response\n");
-                if (cJSON_HasObjectItem(root, "error")) {
-                    const char* error_msg = cJSON_GetObjectItem(root, "error")->valuestring;
-                    fprintf(stderr, "API Error: %s\n", error_msg);
-                }
-            }
+// Вспомогательная функция. Кратчайшая запись числа, которая читается обратно без потерь
+static const char* format_number(double value, char buffer[32]) {
+    snprintf(buffer, 32, "%.15g", value);
+    if (strtod(buffer, NULL) != value) snprintf(buffer, 32, "%.17g", value);
+    return buffer;
+}
 
-            // Создание структуры данных
-            result = malloc(sizeof(SheetRange));
-            result->rows = cJSON_GetArraySize(values);
-            result->cols = 0;
-            result->data = NULL;
+// Вспомогательная функция. Текст ячейки values: строка забирается у cJSON
+// без копии (тем же аллокатором; cJSON_Delete пропускает NULL), числа и
+// логические значения форматируются. NULL - пустая ячейка или другой тип
+static char* sheet_cell_take_text(cJSON* cell) {
+    if (cJSON_IsString(cell)) {
+        char* text = cell->valuestring;
+        cell->valuestring = NULL;
+        return text;
+    }
+    if (cJSON_IsNumber(cell) || cJSON_IsBool(cell)) {
+        // Без форматирования (FORMULA, UNFORMATTED_VALUE) числа и
+        // логические значения приходят не строками
+        char number[32];
+        return gsheet_strdup(cJSON_IsNumber(cell)
+            ? format_number(cell->valuedouble, number)
+            : (cJSON_IsTrue(cell) ? "TRUE" : "FALSE"));
+    }
+    return NULL;
+}
 
-            if (result->rows == 0) {
-                cJSON_Delete(root);
-            }
+// Вспомогательная функция. Сборка SheetRange из массива values за один проход:
+// строки и ячейки обходятся по спискам cJSON (cJSON_GetArrayItem каждый раз
+// идёт от начала списка), указатели на строки копятся в растущем векторе,
+// а затем раскладываются в таблицу rows x cols, выделенную одним блоком
+static SheetRange* sheet_range_from_values(GSheetClient* client, cJSON* values) {
+    char** cells = NULL;     // ячейки всех строк подряд
+    size_t* widths = NULL;   // число ячеек в каждой строке
+    size_t cell_count = 0, cell_cap = 0;
+    size_t rows = 0, row_cap = 0, cols = 0;
+    int ok = 1;
 
-            // Первый проход: определение максимального количества столбцов
-            for (int i = 0; i < result->rows; i++) {
-                cJSON* row = cJSON_GetArrayItem(values, i);
-                if (cJSON_IsArray(row)) {
-                    int cols = cJSON_GetArraySize(row);
-                    if (cols > result->cols) {
-                        result->cols = cols;
-                    }
-                }
+    cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        if (rows == row_cap) {
+            row_cap = row_cap ? row_cap * 2 : 64;
+            size_t* grown = gsheet_realloc(widths, sizeof(size_t) * row_cap);
+            if (!grown) {
+                ok = 0;
+                break;
             }
+            widths = grown;
+        }
 
-            // Выделение памяти
-            result->data = malloc(sizeof(char**) * result->rows);
-            for (int i = 0; i < result->rows; i++) {
-                result->data[i] = malloc(sizeof(char*) * result->cols);
-                // Инициализация NULL
-                memset(result->data[i], 0, sizeof(char*) * result->cols);
+        size_t width = 0;
+        cJSON* row_cells = cJSON_IsArray(row) ? row : NULL;
+        cJSON* cell = NULL;
+        cJSON_ArrayForEach(cell, row_cells) {
+            if (cell_count == cell_cap) {
+                cell_cap = cell_cap ? cell_cap * 2 : 256;
+                char** grown = gsheet_realloc(cells, sizeof(char*) * cell_cap);
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                cells = grown;
             }
+            cells[cell_count++] = sheet_cell_take_text(cell);
+            width++;
+        }
+        if (!ok) break;
+        widths[rows++] = width;
+        if (width > cols) cols = width;
+    }
 
-            // Второй проход: заполнение данными
-            for (int i = 0; i < result->rows; i++) {
-                cJSON* row = cJSON_GetArrayItem(values, i);
-                if (!cJSON_IsArray(row)) continue;
+    // Таблица строк и ячейки одним блоком: [char** x rows][char* x rows*cols]
+    SheetRange* result = NULL;
+    char*** table = NULL;
+    if (ok && rows > 0 && cols > (SIZE_MAX / sizeof(char*) - 1) / rows) ok = 0;
+    if (ok) {
+        result = gsheet_malloc(sizeof(SheetRange));
+        table = rows ? gsheet_malloc(sizeof(char**) * rows + sizeof(char*) * rows * cols) : NULL;
+        if (!result || (rows && !table)) ok = 0;
+    }
 
-                for (int j = 0; j < result->cols; j++) {
-                    cJSON* cell = cJSON_GetArrayItem(row, j);
-                    if (cJSON_IsString(cell)) {
-                        // Копирование строки
-                        result->data[i][j] = strdup(cell->valuestring);
-                    } else {
-                        // Пустые ячейки или нестроковые значения
-                        result->data[i][j] = strdup("");
-                    }
-                }
+    if (ok) {
+        char** block = (char**)(table + rows);
+        size_t next = 0;
+        for (size_t i = 0; i < rows; i++) {
+            char** line = block + i * cols;
+            table[i] = line;
+            for (size_t j = 0; j < cols; j++) {
+                // Пустые ячейки или нестроковые значения
+                char* text = j < widths[i] ? cells[next + j] : NULL;
+                line[j] = text ? text : gsheet_strdup("");
             }
+            next += widths[i];
+        }
+        result->data = table;
+        result->rows = rows;
+        result->cols = cols;
+        result->allocator = client->allocator;
+        result->row_block = true;
+    }
+    else {
+        fprintf(stderr, "Out of memory while building range\n");
+        for (size_t k = 0; k < cell_count; k++) gsheet_mem_free(cells[k]);
+        gsheet_mem_free(table);
+        gsheet_mem_free(result);
+        result = NULL;
+    }
+
+    gsheet_mem_free(widths);
+    gsheet_mem_free(cells);
+    return result;
+}
 
-            cJSON_Delete(root);
+// Вспомогательная функция. Поле values ответа; *values == NULL - пустой
+// диапазон (поля нет). Неразобранное тело, {"error": ...} и values не
+// массивом - ошибка запроса, она учитывается в метриках
+static int gsheet_response_values(GSheetClient* client, cJSON* root, cJSON** values) {
+    *values = NULL;
+    if (!cJSON_IsObject(root)) {
+        fprintf(stderr, "Failed to parse JSON response\n");
+    }
+    else {
+        // error - объект {"code", "message", "status"}, но встречается и строкой
+        cJSON* error = cJSON_GetObjectItem(root, "error");
+        cJSON* field = cJSON_GetObjectItem(root, "values");
+        if (error && !cJSON_IsNull(error)) {
+            const char* error_msg = cJSON_IsString(error)
+                ? error->valuestring
+                : cJSON_GetStringValue(cJSON_GetObjectItem(error, "message"));
+            fprintf(stderr, "API Error: %s\n", error_msg ? error_msg : "unknown");
+        }
+        else if (field && !cJSON_IsArray(field)) {
+            fprintf(stderr, "Malformed 'values' field in response\n");
+        }
+        else {
+            *values = field;
+            return 1;
         }
     }
+    gsheet_atomic_add(&client->metrics.errors, 1);
+    return 0;
+}
 
-    // Очистка ресурсов
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    free(response);
+// Вспомогательная функция. Разбор ответа values в SheetRange
+// Парсинг идёт прямо из буфера соединения, без копии
+static SheetRange* gsheet_parse_values(GSheetClient* client, const GSheetBuffer* body) {
+    SheetRange* result = NULL;
+    uint64_t parse_start = gsheet_now_us();
+    cJSON* root = cJSON_ParseWithLength(body->data, body->len);
+    gsheet_histogram_observe(&client->metrics.timers[GSHEET_TIMER_PARSE], gsheet_now_us() - parse_start);
+    cJSON* values = NULL;
+    if (gsheet_response_values(client, root, &values)) {
+        // Создание структуры данных
+        uint64_t build_start = gsheet_now_us();
+        result = sheet_range_from_values(client, values);
+
+        gsheet_histogram_observe(&client->metrics.timers[GSHEET_TIMER_BUILD], gsheet_now_us() - build_start);
+    }
 
+    cJSON_Delete(root);
     return result;
 }
 
-// 3. Write in smth range
-boolean gsheet_write_range(GSheetClient* client, const char* range, SheetRange* data) {
-    CURL* curl = curl_easy_init();
-    char url[256];
-    snprintf(url, sizeof(url),
-        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s?valueInputOption=RAW",
-        client->spreadsheet_id, range
-    );
-
+// Вспомогательная функция. Тело запроса записи {"values": [[...], ...]}
+static char* gsheet_build_values_payload(const SheetRange* data) {
     cJSON* root = cJSON_CreateObject();
     cJSON* values = cJSON_AddArrayToObject(root, "values");
 
@@ -260,67 +1005,110 @@ boolean gsheet_write_range(GSheetClient* client, const char* range, SheetRange*
     }
 
     char* payload = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return payload;
+}
 
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, build_auth_header(client));
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-
-    CURLcode res = curl_easy_perform(curl);
+// Вспомогательная функция. GET values с параметрами query ("" или "?valueRenderOption=...")
+static SheetRange* gsheet_read_values(GSheetClient* client, const char* range, const char* query) {
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
     long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    char url[1024];
 
-    boolean success = (res == CURLE_OK && http_code == 200);
-    if (!success) {
+    // Формирование URL
+    snprintf(url, sizeof(url), 
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s%s",
+        client->spreadsheet_id, range, query);
+
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (!connection) {
+        gsheet_alloc_leave(previous_scope);
+        return NULL;
+    }
+    CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+
+    SheetRange* result = NULL;
+    if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+        result = gsheet_parse_values(client, &connection->body);
+    }
+
+    gsheet_connection_release(client, connection);
+    gsheet_alloc_leave(previous_scope);
+
+    return result;
+}
+
+// 2. read gsheet in specified range
+SheetRange* gsheet_read_range(GSheetClient* client, const char* range) {
+    return gsheet_read_values(client, range, "");
+}
+
+// 3. Write in smth range
+bool gsheet_write_range(GSheetClient* client, const char* range, SheetRange* data) {
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    char url[1024];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s?valueInputOption=RAW",
+        client->spreadsheet_id, range
+    );
+
+    char* payload = gsheet_build_values_payload(data);
+
+    CURLcode res = CURLE_FAILED_INIT;
+    long http_code = 0;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (connection) {
+        res = gsheet_http_request(client, connection, "PUT", url, payload, &http_code);
+        gsheet_connection_release(client, connection);
+    }
+
+    bool success = (res == CURLE_OK && http_code == 200);
+    if (!success) {
         fprintf(stderr, "Write failed. HTTP Code: %ld\n", http_code);
     }
 
-    cJSON_Delete(root);
-    free(payload);
-    curl_easy_cleanup(curl);
-    return (res == CURLE_OK);
+    gsheet_mem_free(payload);
+    gsheet_alloc_leave(previous_scope);
+    return success;
 }
 
 // 1. Создать новую таблицу
 char* gsheet_create_spreadsheet(GSheetClient* client, const char* title) {
-    CURL* curl = curl_easy_init();
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "properties.title", title);
 
     char* payload = cJSON_PrintUnformatted(root);
-    char* response = NULL;
-    
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, build_auth_header(client));
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_URL, "https://sheets.googleapis.com/v4/spreadsheets");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-    CURLcode res = curl_easy_perform(curl);
     char* spreadsheet_id = NULL;
+    long http_code = 0;
+
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (connection) {
+        CURLcode res = gsheet_http_request(client, connection, "POST",
+            "https://sheets.googleapis.com/v4/spreadsheets", payload, &http_code);
     
-    if (res == CURLE_OK && response) {
-        cJSON* json = cJSON_Parse(response);
-        spreadsheet_id = strdup(cJSON_GetStringValue(cJSON_GetObjectItem(json, "spreadsheetId")));
-        cJSON_Delete(json);
+        if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+            cJSON* json = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+            const char* id = cJSON_GetStringValue(cJSON_GetObjectItem(json, "spreadsheetId"));
+            if (id) {
+                spreadsheet_id = strdup(id);
+            }
+            else {
+                fprintf(stderr, "No 'spreadsheetId' field in response\n");
+            }
+            cJSON_Delete(json);
+        }
+        gsheet_connection_release(client, connection);
     }
 
     cJSON_Delete(root);
-    free(payload);
-    curl_easy_cleanup(curl);
+    gsheet_mem_free(payload);
+    gsheet_alloc_leave(previous_scope);
     return spreadsheet_id;
 }
 
 // 2. Добавить новый лист
-boolean gsheet_add_sheet(GSheetClient* client, const char* sheet_title) {
+bool gsheet_add_sheet(GSheetClient* client, const char* sheet_title) {
     cJSON* root = cJSON_CreateObject();
     cJSON* requests = cJSON_AddArrayToObject(root, "requests");
     cJSON* add_sheet = cJSON_CreateObject();
@@ -336,7 +1124,7 @@ boolean gsheet_add_sheet(GSheetClient* client, const char* sheet_title) {
 
     // Отправка запроса (аналогично gsheet_write_range)
     // ...
-    return TRUE;
+    return true;
 }
 
 
@@ -353,7 +1141,7 @@ void gsheet_get_sheet_info(GSheetClient* client) {
 }
 
 // 4. Очистить диапазон
-boolean gsheet_clear_range(GSheetClient* client, const char* range) {
+bool gsheet_clear_range(GSheetClient* client, const char* range) {
     char url[256];
     snprintf(url, sizeof(url), 
         "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s:clear",
@@ -362,42 +1150,44 @@ boolean gsheet_clear_range(GSheetClient* client, const char* range) {
 
     // POST-запрос с пустым телом
     // ...
-    return TRUE;
+    return true;
 }
 
 
 // 5. Удалить строку
-boolean gsheet_delete_row(GSheetClient* client, int sheet_id, int row) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON* requests = cJSON_AddArrayToObject(root, "requests");
+bool gsheet_delete_row(GSheetClient* client, int sheet_id, int row) {
+    cJSON* requests = cJSON_CreateArray();
     cJSON* delete_dim = cJSON_CreateObject();
-    cJSON* range = cJSON_AddObjectToObject(delete_dim, "deleteDimension");
-    cJSON* dim = cJSON_AddObjectToObject(range, "dimension");
-    cJSON_AddNumberToObject(dim, "sheetId", sheet_id);
-    cJSON_AddStringToObject(dim, "dimension", "ROWS");
-    cJSON_AddNumberToObject(dim, "startIndex", row);
-    cJSON_AddNumberToObject(dim, "endIndex", row + 1);
     cJSON_AddItemToArray(requests, delete_dim);
+    cJSON* delete_params = cJSON_AddObjectToObject(delete_dim, "deleteDimension");
+    cJSON* range = cJSON_AddObjectToObject(delete_params, "range");
+    cJSON_AddNumberToObject(range, "sheetId", sheet_id);
+    cJSON_AddStringToObject(range, "dimension", "ROWS");
+    cJSON_AddNumberToObject(range, "startIndex", row);
+    cJSON_AddNumberToObject(range, "endIndex", row + 1);
 
     // Отправка batchUpdate
-    // ...
-    return TRUE;
+    bool result = gsheet_batch_update(client, requests);
+    cJSON_Delete(requests);
+    return result;
 }
 
 
 // 6. Переименовать лист
-boolean gsheet_rename_sheet(GSheetClient* client, int sheet_id, const char* new_name) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON* requests = cJSON_AddArrayToObject(root, "requests");
+bool gsheet_rename_sheet(GSheetClient* client, int sheet_id, const char* new_name) {
+    cJSON* requests = cJSON_CreateArray();
     cJSON* update_props = cJSON_CreateObject();
-    cJSON* props = cJSON_AddObjectToObject(update_props, "updateSheetProperties");
+    cJSON_AddItemToArray(requests, update_props);
+    cJSON* update_params = cJSON_AddObjectToObject(update_props, "updateSheetProperties");
+    cJSON* props = cJSON_AddObjectToObject(update_params, "properties");
     cJSON_AddNumberToObject(props, "sheetId", sheet_id);
     cJSON_AddStringToObject(props, "title", new_name);
-    cJSON_AddItemToArray(requests, update_props);
+    cJSON_AddStringToObject(update_params, "fields", "title");
 
     // Отправка batchUpdate
-    // ...
-    return TRUE;
+    bool result = gsheet_batch_update(client, requests);
+    cJSON_Delete(requests);
+    return result;
 }
 
 
@@ -414,38 +1204,77 @@ void gsheet_get_history(GSheetClient* client) {
 }
 
 // 9. Изменить форматирование ячейки
-boolean gsheet_format_cell(GSheetClient* client, int sheet_id, const char* cell, int bg_color) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON* requests = cJSON_AddArrayToObject(root, "requests");
+static size_t calc_parse_a1(const char* text, size_t len, size_t* row, size_t* col, int* has_row, int* has_col);
+
+// bg_color - 0xRRGGBB, cell - адрес одной ячейки (B2)
+bool gsheet_format_cell(GSheetClient* client, int sheet_id, const char* cell, int bg_color) {
+    size_t row = 0, col = 0;
+    int has_row = 0, has_col = 0;
+    const size_t len = cell ? strlen(cell) : 0;
+    if (!cell || calc_parse_a1(cell, len, &row, &col, &has_row, &has_col) != len || !has_row || !has_col) {
+        fprintf(stderr, "gsheet_format_cell: '%s' is not a single cell address\n", cell ? cell : "(null)");
+        return false;
+    }
+
+    cJSON* requests = cJSON_CreateArray();
     cJSON* format_req = cJSON_CreateObject();
+    cJSON_AddItemToArray(requests, format_req);
     cJSON* cell_format = cJSON_AddObjectToObject(format_req, "repeatCell");
-    
+
     // Формирование JSON для формата
-    // ...
-    
+    cJSON* range = cJSON_AddObjectToObject(cell_format, "range");
+    cJSON_AddNumberToObject(range, "sheetId", sheet_id);
+    cJSON_AddNumberToObject(range, "startRowIndex", (double)row);
+    cJSON_AddNumberToObject(range, "endRowIndex", (double)row + 1);
+    cJSON_AddNumberToObject(range, "startColumnIndex", (double)col);
+    cJSON_AddNumberToObject(range, "endColumnIndex", (double)col + 1);
+    cJSON* format = cJSON_AddObjectToObject(cJSON_AddObjectToObject(cell_format, "cell"), "userEnteredFormat");
+    cJSON* color = cJSON_AddObjectToObject(format, "backgroundColor");
+    cJSON_AddNumberToObject(color, "red", ((bg_color >> 16) & 0xFF) / 255.0);
+    cJSON_AddNumberToObject(color, "green", ((bg_color >> 8) & 0xFF) / 255.0);
+    cJSON_AddNumberToObject(color, "blue", (bg_color & 0xFF) / 255.0);
+    cJSON_AddStringToObject(cell_format, "fields", "userEnteredFormat.backgroundColor");
+
     // Отправка batchUpdate
-    return TRUE;
+    bool result = gsheet_batch_update(client, requests);
+    cJSON_Delete(requests);
+    return result;
 }
 
 // 10. Пакетное обновление
-boolean gsheet_batch_update(GSheetClient* client, cJSON* requests) {
+bool gsheet_batch_update(GSheetClient* client, cJSON* requests) {
     char url[256];
     snprintf(url, sizeof(url), 
         "https://sheets.googleapis.com/v4/spreadsheets/%s:batchUpdate",
         client->spreadsheet_id
     );
 
-    // Отправка POST-запроса с JSON из `requests`
-    // ...
-    return TRUE;
+    // Отправка POST-запроса с JSON из `requests`: {"requests": [...]}
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    char* items = cJSON_PrintUnformatted(requests);
+    const size_t payload_len = (items ? strlen(items) : 0) + sizeof("{\"requests\":}");
+    char* payload = items ? gsheet_malloc(payload_len) : NULL;
+    CURLcode res = CURLE_FAILED_INIT;
+    long http_code = 0;
+
+    GSheetConnection* connection = payload ? gsheet_connection_acquire(client) : NULL;
+    if (connection) {
+        snprintf(payload, payload_len, "{\"requests\":%s}", items);
+        res = gsheet_http_request(client, connection, "POST", url, payload, &http_code);
+        gsheet_connection_release(client, connection);
+    }
+
+    gsheet_mem_free(payload);
+    gsheet_mem_free(items);
+    gsheet_alloc_leave(previous_scope);
+    return res == CURLE_OK && http_code == 200;
 }
 
 
 
 // 11. Удаляем лист
 void gsheet_delete_sheet(GSheetClient* client, int sheet_id) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON* requests = cJSON_AddArrayToObject(root, "requests");
+    cJSON* requests = cJSON_CreateArray();
 
     cJSON* delete_sheet = cJSON_CreateObject();
     cJSON_AddItemToObject(delete_sheet, "deleteSheet",
@@ -455,7 +1284,10 @@ void gsheet_delete_sheet(GSheetClient* client, int sheet_id) {
     cJSON_AddItemToArray(requests, delete_sheet);
 
     // Отправка batchUpdate
-    // ... (реализация аналогично gsheet_write_range)
+    if (!gsheet_batch_update(client, requests)) {
+        fprintf(stderr, "gsheet_delete_sheet: batchUpdate failed for sheet %d\n", sheet_id);
+    }
+    cJSON_Delete(requests);
 }
 
 // 12. Чтение ячейки
@@ -466,7 +1298,7 @@ SheetRange* gsheet_read_cell(GSheetClient* client, int row, int col) {
 }
 
 // 13. Добавление строки в таблицу
-boolean gsheet_append_row(GSheetClient* client, const char* sheet_name, char*** row_data, size_t cols) {
+bool gsheet_append_row(GSheetClient* client, const char* sheet_name, char*** row_data, size_t cols) {
     char range[64];
     snprintf(range, sizeof(range), "%s!A:A", sheet_name);
     SheetRange data = { .rows = 1, .cols = cols, .data = row_data };
@@ -474,41 +1306,154 @@ boolean gsheet_append_row(GSheetClient* client, const char* sheet_name, char***
 }
 
 // 14. Сортировка
+
+// Вспомогательная функция. sheetId листа по названию; NULL - первый лист
+// (адрес A1 без имени листа API относит к первому листу)
+static bool gsheet_find_sheet_id(GSheetClient* client, const char* sheet_title, long* sheet_id) {
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    long http_code = 0;
+    char url[512];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s?fields=sheets.properties(sheetId,title)",
+        client->spreadsheet_id);
+
+    bool found = false;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (!connection) {
+        gsheet_alloc_leave(previous_scope);
+        return false;
+    }
+    CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+
+    if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+        cJSON* json = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        cJSON* sheet = NULL;
+        cJSON_ArrayForEach(sheet, cJSON_GetObjectItem(json, "sheets")) {
+            cJSON* props = cJSON_GetObjectItem(sheet, "properties");
+            const char* title = cJSON_GetStringValue(cJSON_GetObjectItem(props, "title"));
+            cJSON* id = cJSON_GetObjectItem(props, "sheetId");
+            if (sheet_title && (!title || strcmp(title, sheet_title) != 0)) continue;
+            if (cJSON_IsNumber(id)) {
+                *sheet_id = (long)id->valuedouble;
+                found = true;
+            }
+            break;
+        }
+        cJSON_Delete(json);
+    }
+    if (!found) fprintf(stderr, "Sheet not found: %s\n", sheet_title ? sheet_title : "(first sheet)");
+
+    gsheet_connection_release(client, connection);
+    gsheet_alloc_leave(previous_scope);
+    return found;
+}
+
+// Вспомогательная функция. Адрес A1 ("Лист!A2:D10", "'Мой лист'!B:D", "A1:C5",
+// "Лист") -> название листа (пустое - первый лист) и границы GridRange.
+// Границы, которых нет в адресе (B:D, 2:10, целый лист), остаются открытыми
+typedef struct {
+    char sheet[256];
+    size_t start_row, end_row, start_col, end_col;
+    int has_start_row, has_end_row, has_start_col, has_end_col;
+} A1Range;
+
+static bool parse_a1_range(const char* range, A1Range* out) {
+    memset(out, 0, sizeof(*out));
+    const char* cells = range;
+    const char* bang = strrchr(range, '!');
+    const char* name = NULL;
+    size_t name_len = 0;
+    if (bang) {
+        name = range;
+        name_len = (size_t)(bang - range);
+        cells = bang + 1;
+    }
+    else {
+        size_t row = 0, col = 0;
+        int has_row = 0, has_col = 0;
+        const size_t len = strcspn(range, ":");
+        // Без '!' одиночное "ABC" - имя листа, а не столбец
+        if (calc_parse_a1(range, len, &row, &col, &has_row, &has_col) != len || (!has_row && range[len] != ':')) {
+            name = range;
+            name_len = strlen(range);
+            cells = "";
+        }
+    }
+
+    // Имя в кавычках: '' внутри означает одну кавычку
+    if (name_len >= 2 && name[0] == '\'' && name[name_len - 1] == '\'') {
+        name++;
+        name_len -= 2;
+    }
+    size_t out_len = 0;
+    for (size_t i = 0; i < name_len; i++) {
+        if (out_len + 1 >= sizeof(out->sheet)) return false;
+        out->sheet[out_len++] = name[i];
+        if (name[i] == '\'' && i + 1 < name_len && name[i + 1] == '\'') i++;
+    }
+    out->sheet[out_len] = '\0';
+    if (!*cells) return true;
+
+    size_t row = 0, col = 0;
+    int has_row = 0, has_col = 0;
+    const size_t first_len = strcspn(cells, ":");
+    if (calc_parse_a1(cells, first_len, &row, &col, &has_row, &has_col) != first_len) return false;
+    out->start_row = row;
+    out->start_col = col;
+    out->has_start_row = has_row;
+    out->has_start_col = has_col;
+
+    if (cells[first_len] == ':') {
+        const char* second = cells + first_len + 1;
+        const size_t second_len = strlen(second);
+        if (calc_parse_a1(second, second_len, &row, &col, &has_row, &has_col) != second_len) return false;
+    }
+    // Одиночная ячейка A1 - диапазон A1:A1
+    out->end_row = row + 1;
+    out->end_col = col + 1;
+    out->has_end_row = has_row;
+    out->has_end_col = has_col;
+    return true;
+}
+
+// Серверная сортировка: sortRange с GridRange (sheetId и индексы), поэтому
+// формулы, числа, даты и форматы строк сохраняются. column_index - номер
+// столбца внутри диапазона, с 0. Локальная сортировка с записью обратно -
+// gsheet_sort_write_back (раздел 29)
 int gsheet_sort_range(GSheetClient* client, const char* range, int column_index) {
+    if (!client || !range || column_index < 0) return false;
+    A1Range a1;
+    if (!parse_a1_range(range, &a1)) {
+        fprintf(stderr, "Invalid range: %s\n", range);
+        return false;
+    }
+    long sheet_id = 0;
+    if (!gsheet_find_sheet_id(client, a1.sheet[0] ? a1.sheet : NULL, &sheet_id)) return false;
+
     cJSON* requests = cJSON_CreateArray();
-    cJSON* sort_request = cJSON_CreateObject();
-    
-    // Создаем объект sortRange
-    cJSON* sort_range = cJSON_CreateObject();
-    
-    // Добавляем поле range
-    cJSON_AddStringToObject(sort_range, "range", range);
-    
-    // Создаем массив sortSpecs
-    cJSON* sort_specs = cJSON_CreateArray();
+    cJSON* sort = cJSON_CreateObject();
+    cJSON* params = cJSON_AddObjectToObject(sort, "sortRange");
+    cJSON* grid = cJSON_AddObjectToObject(params, "range");
+    cJSON_AddNumberToObject(grid, "sheetId", (double)sheet_id);
+    if (a1.has_start_row) cJSON_AddNumberToObject(grid, "startRowIndex", (double)a1.start_row);
+    if (a1.has_end_row) cJSON_AddNumberToObject(grid, "endRowIndex", (double)a1.end_row);
+    if (a1.has_start_col) cJSON_AddNumberToObject(grid, "startColumnIndex", (double)a1.start_col);
+    if (a1.has_end_col) cJSON_AddNumberToObject(grid, "endColumnIndex", (double)a1.end_col);
+
     cJSON* spec = cJSON_CreateObject();
-    cJSON_AddNumberToObject(spec, "dimensionIndex", column_index);
+    cJSON_AddNumberToObject(spec, "dimensionIndex", (double)(a1.start_col + (size_t)column_index));
     cJSON_AddStringToObject(spec, "sortOrder", "ASCENDING");
-    cJSON_AddItemToArray(sort_specs, spec);
-    printf("Hello there!\n");
-    
-    // Добавляем sortSpecs в sortRange
-    cJSON_AddItemToObject(sort_range, "sortSpecs", sort_specs);
-    
-    // Собираем итоговый запрос
-    cJSON_AddItemToObject(sort_request, "sortRange", sort_range);
-    cJSON_AddItemToArray(requests, sort_request);
-    
-    // Отправляем запрос и возвращаем результат
+    cJSON_AddItemToArray(cJSON_AddArrayToObject(params, "sortSpecs"), spec);
+    cJSON_AddItemToArray(requests, sort);
+
     int result = gsheet_batch_update(client, requests);
-    
-    // Очищаем JSON-структуры
+    if (!result) fprintf(stderr, "Sort failed: %s\n", range);
     cJSON_Delete(requests);
     return result;
 }
 
 // 15. Установка формулы
-boolean gsheet_set_formula(GSheetClient* client, const char* cell, char*** formula) {
+bool gsheet_set_formula(GSheetClient* client, const char* cell, char*** formula) {
     SheetRange data = {
         .rows = 1,
         .cols = 1,
@@ -568,14 +1513,15 @@ char** gsheet_search(GSheetClient* client, const char* query, int* result_count)
             cJSON* matches = cJSON_GetObjectItem(json, "matches");
             if(matches && cJSON_IsArray(matches)) {
                 *result_count = cJSON_GetArraySize(matches);
-                search_results = malloc(*result_count * sizeof(char*));
+                search_results = calloc(*result_count ? *result_count : 1, sizeof(char*));
                 
                 // Парсим каждое совпадение
                 for(int i = 0; i < *result_count; i++) {
                     cJSON* match = cJSON_GetArrayItem(matches, i);
                     cJSON* cell = cJSON_GetObjectItem(match, "cell");
-                    if(cell) {
-                        search_results[i] = strdup(cJSON_GetStringValue(cell));
+                    const char* text = cJSON_GetStringValue(cell);
+                    if(search_results && text) {
+                        search_results[i] = strdup(text);
                     }
                 }
             }
@@ -592,41 +1538,3921 @@ char** gsheet_search(GSheetClient* client, const char* query, int* result_count)
 }
 
 // 18. Экспорт в CSV
-boolean gsheet_export_csv(GSheetClient* client, const char* range, const char* filename) {
+bool gsheet_export_csv(GSheetClient* client, const char* range, const char* filename) {
     SheetRange* data = gsheet_read_range(client, range);
-    if (!data) return FALSE;
+    if (!data) return false;
 
     FILE* fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "gsheet_export_csv: cannot open %s\n", filename);
+        gsheet_free_range(data);
+        return false;
+    }
+
+    // RFC 4180: поля с запятой, кавычкой или переводом строки - в кавычках, кавычки удваиваются
     for (size_t i = 0; i < data->rows; i++) {
-        fprintf(fp, "%s\n", data->data[i]);
+        for (size_t j = 0; j < data->cols; j++) {
+            const char* text = data->data[i][j] ? data->data[i][j] : "";
+            if (j) fputc(',', fp);
+            if (strpbrk(text, ",\"\r\n")) {
+                fputc('"', fp);
+                for (const char* c = text; *c; c++) {
+                    if (*c == '"') fputc('"', fp);
+                    fputc(*c, fp);
+                }
+                fputc('"', fp);
+            } else {
+                fputs(text, fp);
+            }
+        }
+        fputc('\n', fp);
     }
-    fclose(fp);
-    return TRUE;
+
+    const bool ok = !ferror(fp);
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "gsheet_export_csv: write to %s failed\n", filename);
+        gsheet_free_range(data);
+        return false;
+    }
+    gsheet_free_range(data);
+    return true;
 }
 
-int main() {
-    
-    // Инициализация клиента
-    const char* access_token = "token";
-    const char* spreadsheet_id = "1gr3rYU-EHI8XVsFrkHJy2VTpQhFWEiDN1wxXwgqV1lg";
-    GSheetClient* client = gsheet_init(access_token, spreadsheet_id);
-    
-    if (!client) {
-        fprintf(stderr, "Cannot init client\n");
-        return 1;
+// 19. Снимок диапазона на диске (для быстрого холодного старта)
+//
+// Формат файла (порядок байт нативный, файл переносим только между
+// машинами одной архитектуры):
+//   GSheetSnapshotHeader
+//   uint64_t index[rows * cols + 1]  - смещения ячеек в таблице строк
+//   char strings[strings_size]       - тексты ячеек, каждый завершается '\0'
+//   выравнивание до 8 байт
+//   uint64_t numeric_index[cols]     - смещение колонки double[rows] или 0
+//   double column[rows] ...          - только для полностью числовых колонок
+// Файл отображается в память через mmap, ячейки читаются прямо из
+// отображения без разбора и копирования.
+#define GSHEET_SNAPSHOT_MAGIC "GSNP"
+#define GSHEET_SNAPSHOT_VERSION 1u
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t revision;        // ревизия таблицы, которую передал вызывающий код
+    uint64_t created_at;      // время записи снимка (unix time)
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t index_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t numeric_offset;  // 0, если числовых колонок нет
+    uint64_t file_size;
+} GSheetSnapshotHeader;
+
+typedef struct GSheetSnapshot {
+    const unsigned char* base;
+    size_t size;
+    const GSheetSnapshotHeader* header;
+    const uint64_t* index;
+    const char* strings;
+    const uint64_t* numeric_index;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} GSheetSnapshot;
+
+static uint64_t snapshot_align8(uint64_t value) {
+    return (value + 7) & ~(uint64_t)7;
+}
+
+static const char* snapshot_cell_text(const SheetRange* range, size_t row, size_t col) {
+    const char* text = range->data[row][col];
+    return text ? text : "";
+}
+
+// Пустая ячейка в числовой колонке хранится как NAN. Возвращает 1 для числа,
+// 2 для пустой ячейки и 0 для текста. strtod понимает ещё "inf", "nan",
+// hex ("0x1p3") и ведущие пробелы - такие ячейки остаются текстом
+static int snapshot_parse_number(const char* text, double* out) {
+    char* end = NULL;
+    if (*text == '\0') {
+        *out = NAN;
+        return 2;
+    }
+    for (const char* p = text; *p; p++) {
+        if (!strchr("0123456789+-.eE", *p)) return 0;
     }
+    *out = strtod(text, &end);
+    return end != text && *end == '\0' && isfinite(*out);
+}
 
-    // Чтение данных из диапазона
-    const char* range = "Sheet1!A1:E1";
-    SheetRange* data = gsheet_read_range(client, range);
+// Колонка числовая, если в ней есть хотя бы одно число, а остальные ячейки пусты
+static int snapshot_column_is_numeric(const SheetRange* range, size_t col) {
+    double value;
+    int has_number = 0;
+    for (size_t i = 0; i < range->rows; i++) {
+        const int kind = snapshot_parse_number(snapshot_cell_text(range, i, col), &value);
+        if (!kind) return 0;
+        if (kind == 1) has_number = 1;
+    }
+    return has_number;
+}
 
-    if (!data) {
-        fprintf(stderr, "Cannot read data from gsheet\n");
-        return 1;
+// Запись снимка. Пишем во временный файл и атомарно подменяем старый,
+// чтобы параллельно открытые отображения не увидели половину файла.
+bool gsheet_snapshot_save(const SheetRange* range, const char* path, uint64_t revision) {
+    if (!range || !path) return false;
+
+    const size_t cells = range->rows * range->cols;
+    if (range->cols != 0 && cells / range->cols != range->rows) return false;
+
+    uint64_t* index = malloc(sizeof(uint64_t) * (cells + 1));
+    uint64_t* numeric_index = calloc(range->cols + 1, sizeof(uint64_t));
+    if (!index || !numeric_index) {
+        free(index);
+        free(numeric_index);
+        return false;
+    }
+
+    // Таблица смещений строк
+    uint64_t strings_size = 0;
+    for (size_t i = 0; i < range->rows; i++) {
+        for (size_t j = 0; j < range->cols; j++) {
+            index[i * range->cols + j] = strings_size;
+            strings_size += strlen(snapshot_cell_text(range, i, j)) + 1;
+        }
     }
+    index[cells] = strings_size;
 
-    // Вывод данных в консоль
-    print_data_from_gsheet(data, range);
+    GSheetSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GSHEET_SNAPSHOT_MAGIC, 4);
+    header.version = GSHEET_SNAPSHOT_VERSION;
+    header.revision = revision;
+    header.created_at = (uint64_t)time(NULL);
+    header.rows = range->rows;
+    header.cols = range->cols;
+    header.index_offset = sizeof(GSheetSnapshotHeader);
+    header.strings_offset = header.index_offset + sizeof(uint64_t) * (cells + 1);
+    header.strings_size = strings_size;
 
-    return 0;
+    // Типизированные колонки: только те, где каждая ячейка - число или пусто
+    const uint64_t numeric_offset = snapshot_align8(header.strings_offset + strings_size);
+    uint64_t column_offset = numeric_offset + sizeof(uint64_t) * range->cols;
+    size_t numeric_cols = 0;
+    for (size_t j = 0; j < range->cols; j++) {
+        if (snapshot_column_is_numeric(range, j)) {
+            numeric_index[j] = column_offset;
+            column_offset += sizeof(double) * range->rows;
+            numeric_cols++;
+        }
+    }
+    header.numeric_offset = numeric_cols ? numeric_offset : 0;
+    header.file_size = numeric_cols ? column_offset : header.strings_offset + strings_size;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Cannot create snapshot file %s\n", tmp_path);
+        free(index);
+        free(numeric_index);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(index, sizeof(uint64_t), cells + 1, fp);
+    for (size_t i = 0; i < range->rows; i++) {
+        for (size_t j = 0; j < range->cols; j++) {
+            const char* text = snapshot_cell_text(range, i, j);
+            fwrite(text, 1, strlen(text) + 1, fp);
+        }
+    }
+
+    if (numeric_cols) {
+        static const char padding[8] = { 0 };
+        fwrite(padding, 1, numeric_offset - (header.strings_offset + strings_size), fp);
+        fwrite(numeric_index, sizeof(uint64_t), range->cols, fp);
+        for (size_t j = 0; j < range->cols; j++) {
+            if (!numeric_index[j]) continue;
+            for (size_t i = 0; i < range->rows; i++) {
+                double value;
+                snapshot_parse_number(snapshot_cell_text(range, i, j), &value);
+                fwrite(&value, sizeof(double), 1, fp);
+            }
+        }
+    }
+
+    bool success = !ferror(fp);
+    if (fclose(fp) != 0) success = false;
+    free(index);
+    free(numeric_index);
+
+    if (success) {
+#ifdef _WIN32
+        success = MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING) ? true : false;
+#else
+        success = rename(tmp_path, path) == 0;
+#endif
+    }
+    if (!success) {
+        fprintf(stderr, "Failed to write snapshot %s\n", path);
+        remove(tmp_path);
+    }
+    return success;
+}
+
+// Проверяем только заголовок и границы секций - O(1), без обхода ячеек
+static int snapshot_validate(GSheetSnapshot* snap) {
+    if (snap->size < sizeof(GSheetSnapshotHeader)) return 0;
+
+    const GSheetSnapshotHeader* header = (const GSheetSnapshotHeader*)snap->base;
+    if (memcmp(header->magic, GSHEET_SNAPSHOT_MAGIC, 4) != 0) return 0;
+    if (header->version != GSHEET_SNAPSHOT_VERSION) return 0;
+    if (header->file_size != snap->size) return 0;
+    if (header->index_offset != sizeof(GSheetSnapshotHeader)) return 0;
+
+    const uint64_t cells = header->rows * header->cols;
+    if (header->cols != 0 && cells / header->cols != header->rows) return 0;
+    if (cells >= (snap->size - header->index_offset) / sizeof(uint64_t)) return 0;
+    if (header->strings_offset != header->index_offset + sizeof(uint64_t) * (cells + 1)) return 0;
+    if (header->strings_size > snap->size - header->strings_offset) return 0;
+
+    const uint64_t* index = (const uint64_t*)(snap->base + header->index_offset);
+    if (index[cells] != header->strings_size) return 0;
+    // Последняя ячейка завершает секцию строк; терминаторы остальных
+    // проверяет gsheet_snapshot_cell при обращении
+    if (cells && (header->strings_size == 0 ||
+                  snap->base[header->strings_offset + header->strings_size - 1] != '\0')) return 0;
+
+    if (header->numeric_offset) {
+        if (header->numeric_offset % 8 != 0) return 0;
+        if (header->numeric_offset < header->strings_offset + header->strings_size) return 0;
+        if (header->cols > (snap->size - header->numeric_offset) / sizeof(uint64_t)) return 0;
+        snap->numeric_index = (const uint64_t*)(snap->base + header->numeric_offset);
+    }
+
+    snap->header = header;
+    snap->index = index;
+    snap->strings = (const char*)(snap->base + header->strings_offset);
+    return 1;
+}
+
+void gsheet_snapshot_close(GSheetSnapshot* snap) {
+    if (!snap) return;
+#ifdef _WIN32
+    if (snap->base) UnmapViewOfFile(snap->base);
+    if (snap->mapping) CloseHandle(snap->mapping);
+    if (snap->file && snap->file != INVALID_HANDLE_VALUE) CloseHandle(snap->file);
+#else
+    if (snap->base) munmap((void*)snap->base, snap->size);
+#endif
+    free(snap);
+}
+
+// Открытие снимка: только mmap, данные подтягиваются по первому обращению
+GSheetSnapshot* gsheet_snapshot_open(const char* path) {
+    GSheetSnapshot* snap = calloc(1, sizeof(GSheetSnapshot));
+    if (!snap) return NULL;
+
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    snap->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snap->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(snap->file, &file_size) || file_size.QuadPart == 0) {
+        gsheet_snapshot_close(snap);
+        return NULL;
+    }
+    snap->size = (size_t)file_size.QuadPart;
+    snap->mapping = CreateFileMappingA(snap->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (snap->mapping) {
+        snap->base = MapViewOfFile(snap->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(snap);
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            snap->base = base;
+            snap->size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!snap->base || !snapshot_validate(snap)) {
+        fprintf(stderr, "Invalid snapshot file %s\n", path);
+        gsheet_snapshot_close(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+size_t gsheet_snapshot_rows(const GSheetSnapshot* snap) {
+    return snap ? (size_t)snap->header->rows : 0;
+}
+
+size_t gsheet_snapshot_cols(const GSheetSnapshot* snap) {
+    return snap ? (size_t)snap->header->cols : 0;
+}
+
+uint64_t gsheet_snapshot_revision(const GSheetSnapshot* snap) {
+    return snap ? snap->header->revision : 0;
+}
+
+time_t gsheet_snapshot_created_at(const GSheetSnapshot* snap) {
+    return snap ? (time_t)snap->header->created_at : 0;
+}
+
+// Текст ячейки указывает прямо в отображённый файл и живёт до gsheet_snapshot_close
+const char* gsheet_snapshot_cell(const GSheetSnapshot* snap, size_t row, size_t col, size_t* len) {
+    if (!snap || row >= snap->header->rows || col >= snap->header->cols) return NULL;
+
+    const size_t cell = row * (size_t)snap->header->cols + col;
+    const uint64_t begin = snap->index[cell];
+    const uint64_t end = snap->index[cell + 1];
+    if (begin >= end || end > snap->header->strings_size) return NULL;
+    // Повреждённый снимок: без '\0' строка читалась бы за пределы отображения
+    if (snap->strings[end - 1] != '\0') return NULL;
+
+    if (len) *len = (size_t)(end - begin - 1);
+    return snap->strings + begin;
+}
+
+// Колонка double[rows], если при записи все ячейки колонки были числами, иначе NULL
+const double* gsheet_snapshot_numeric_column(const GSheetSnapshot* snap, size_t col) {
+    if (!snap || !snap->numeric_index || col >= snap->header->cols) return NULL;
+
+    const uint64_t offset = snap->numeric_index[col];
+    if (offset == 0 || offset % 8 != 0) return NULL;
+    if (offset > snap->size || snap->header->rows > (snap->size - offset) / sizeof(double)) return NULL;
+    return (const double*)(snap->base + offset);
+}
+
+// Нужно ли обновить снимок в фоне: ревизия отличается от известной
+// (known_revision == 0 - не проверять) или снимок старше max_age секунд (0 - не проверять)
+bool gsheet_snapshot_is_stale(const GSheetSnapshot* snap, uint64_t known_revision, time_t max_age) {
+    if (!snap) return true;
+    if (known_revision != 0 && known_revision != snap->header->revision) return true;
+    if (max_age > 0 && time(NULL) - gsheet_snapshot_created_at(snap) > max_age) return true;
+    return false;
+}
+
+// 20. Ревизия таблицы (Drive API: version растёт при каждом изменении файла)
+// Возвращает 0, если ревизию получить не удалось (например, нет scope для Drive)
+uint64_t gsheet_get_revision(GSheetClient* client) {
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    long http_code = 0;
+    char url[512];
+    snprintf(url, sizeof(url),
+        "https://www.googleapis.com/drive/v3/files/%s?fields=version,modifiedTime",
+        client->spreadsheet_id);
+
+    uint64_t revision = 0;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (!connection) {
+        gsheet_alloc_leave(previous_scope);
+        return 0;
+    }
+    CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+
+    if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+        cJSON* json = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        const char* version = cJSON_GetStringValue(cJSON_GetObjectItem(json, "version"));
+        if (version) {
+            revision = strtoull(version, NULL, 10);
+        }
+        cJSON_Delete(json);
+    }
+
+    gsheet_connection_release(client, connection);
+    gsheet_alloc_leave(previous_scope);
+    return revision;
+}
+
+// 21. Фоновая синхронизация с вычислением изменений по строкам
+typedef struct {
+    GSheetClient* client;
+    char* range;
+    uint64_t revision;      // последняя обработанная ревизия, 0 - неизвестна
+    uint64_t* row_hashes;   // хеши строк предыдущего снимка
+    size_t row_count;
+    uint64_t next_poll_ms;
+    uint64_t rng_state;
+} GSheetSyncSheet;
+
+typedef struct GSheetSyncEngine {
+    GSheetSyncSheet** sheets;
+    size_t sheet_count;
+    size_t sheet_capacity;
+    uint64_t interval_ms;
+    uint64_t jitter_ms;
+    GSheetSyncCallback callback;
+    void* userdata;
+
+    gsheet_thread_t thread;
+    gsheet_mutex_t mutex;
+    gsheet_cond_t cond;
+    int running;
+    int stop_requested;
+} GSheetSyncEngine;
+
+// FNV-1a, ячейки разделяются байтом 0x1F, чтобы ["ab",""] != ["a","b"]
+static uint64_t sync_hash_row(char** cells, size_t cols) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t j = 0; j < cols; j++) {
+        for (const unsigned char* p = (const unsigned char*)(cells[j] ? cells[j] : ""); *p; p++) {
+            hash ^= *p;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= 0x1F;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// xorshift64: у каждого листа свой генератор для джиттера
+static uint64_t sync_next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static uint64_t sync_jitter(GSheetSyncEngine* engine, GSheetSyncSheet* sheet) {
+    return engine->jitter_ms ? sync_next_random(&sheet->rng_state) % engine->jitter_ms : 0;
+}
+
+static void sync_emit(GSheetSyncEngine* engine, GSheetSyncSheet* sheet,
+                      GSheetSyncEventType type, size_t row, char** cells, size_t cols) {
+    GSheetSyncEvent event = {
+        .type = type,
+        .client = sheet->client,
+        .range = sheet->range,
+        .row = row,
+        .cells = cells,
+        .cols = cols
+    };
+    engine->callback(&event, engine->userdata);
+}
+
+// Сопоставление строк середины по хешу содержимого: хеш -> очередь старых
+// строк с таким хешем (в порядке индексов), открытая адресация
+typedef struct {
+    uint64_t hash;
+    size_t head;            // первая ещё не сопоставленная старая строка, SIZE_MAX - пусто
+    size_t tail;
+    int used;
+} SyncSlot;
+
+static SyncSlot* sync_slot_find(SyncSlot* slots, size_t mask, uint64_t hash) {
+    size_t i = (size_t)(hash ^ (hash >> 32)) & mask;
+    while (slots[i].used && slots[i].hash != hash) i = (i + 1) & mask;
+    return &slots[i];
+}
+
+// Diff старых и новых хешей строк. Общие начало и конец отбрасываются, в
+// середине строка без изменений находится по хешу, даже если сдвинулась.
+// Оставшиеся старые и новые строки попарно дают UPDATE, лишние - INSERT и
+// DELETE. Вставка строки сверху поэтому даёт один INSERT, а не UPDATE всех
+// строк ниже. Возвращает 0 только при нехватке памяти
+static int sync_diff_rows(GSheetSyncEngine* engine, GSheetSyncSheet* sheet, const SheetRange* data,
+                          const uint64_t* hashes) {
+    const uint64_t* old_hashes = sheet->row_hashes;
+    size_t prefix = 0;
+    while (prefix < data->rows && prefix < sheet->row_count && hashes[prefix] == old_hashes[prefix]) prefix++;
+    size_t old_end = sheet->row_count, new_end = data->rows;
+    while (old_end > prefix && new_end > prefix && hashes[new_end - 1] == old_hashes[old_end - 1]) {
+        old_end--;
+        new_end--;
+    }
+    const size_t old_count = old_end - prefix, new_count = new_end - prefix;
+    if (old_count == 0 && new_count == 0) return 1;
+
+    size_t capacity = 16;
+    while (capacity < old_count * 2) capacity *= 2;
+    SyncSlot* slots = calloc(capacity, sizeof(SyncSlot));
+    size_t* next = malloc(sizeof(size_t) * (old_count ? old_count : 1));
+    unsigned char* old_matched = calloc(old_count ? old_count : 1, 1);
+    unsigned char* new_matched = calloc(new_count ? new_count : 1, 1);
+    if (!slots || !next || !old_matched || !new_matched) {
+        free(slots);
+        free(next);
+        free(old_matched);
+        free(new_matched);
+        return 0;
+    }
+
+    for (size_t i = 0; i < old_count; i++) {
+        SyncSlot* slot = sync_slot_find(slots, capacity - 1, old_hashes[prefix + i]);
+        next[i] = SIZE_MAX;
+        if (!slot->used) {
+            slot->used = 1;
+            slot->hash = old_hashes[prefix + i];
+            slot->head = i;
+        }
+        else if (slot->head == SIZE_MAX) {
+            slot->head = i;
+        }
+        else {
+            next[slot->tail] = i;
+        }
+        slot->tail = i;
+    }
+    for (size_t i = 0; i < new_count; i++) {
+        SyncSlot* slot = sync_slot_find(slots, capacity - 1, hashes[prefix + i]);
+        if (slot->used && slot->head != SIZE_MAX) {
+            old_matched[slot->head] = 1;
+            new_matched[i] = 1;
+            slot->head = next[slot->head];
+        }
+    }
+
+    // Несопоставленные строки по порядку: k-я новая заменяет k-ю старую
+    size_t old_cursor = 0;
+    for (size_t i = 0; i < new_count; i++) {
+        if (new_matched[i]) continue;
+        while (old_cursor < old_count && old_matched[old_cursor]) old_cursor++;
+        const size_t row = prefix + i;
+        if (old_cursor < old_count) {
+            old_matched[old_cursor++] = 1;
+            sync_emit(engine, sheet, GSHEET_SYNC_UPDATE, row, data->data[row], data->cols);
+        }
+        else {
+            sync_emit(engine, sheet, GSHEET_SYNC_INSERT, row, data->data[row], data->cols);
+        }
+    }
+    for (size_t i = 0; i < old_count; i++) {
+        if (!old_matched[i]) sync_emit(engine, sheet, GSHEET_SYNC_DELETE, prefix + i, NULL, 0);
+    }
+
+    free(slots);
+    free(next);
+    free(old_matched);
+    free(new_matched);
+    return 1;
+}
+
+// Один цикл опроса листа: сначала дешёвая проверка ревизии, затем чтение и diff
+static void sync_poll_sheet(GSheetSyncEngine* engine, GSheetSyncSheet* sheet) {
+    uint64_t revision = gsheet_get_revision(sheet->client);
+    if (revision != 0 && revision == sheet->revision) return;
+
+    SheetRange* data = gsheet_read_range(sheet->client, sheet->range);
+    if (!data) return;
+
+    uint64_t* hashes = malloc(sizeof(uint64_t) * (data->rows ? data->rows : 1));
+    if (!hashes) {
+        gsheet_free_range(data);
+        return;
+    }
+    for (size_t i = 0; i < data->rows; i++) {
+        hashes[i] = sync_hash_row(data->data[i], data->cols);
+    }
+    // Без памяти на diff прежний снимок остаётся, лист сравнится в следующий раз
+    if (!sync_diff_rows(engine, sheet, data, hashes)) {
+        free(hashes);
+        gsheet_free_range(data);
+        return;
+    }
+
+    free(sheet->row_hashes);
+    sheet->row_hashes = hashes;
+    sheet->row_count = data->rows;
+    sheet->revision = revision;
+    gsheet_free_range(data);
+}
+
+static void sync_worker(void* arg) {
+    GSheetSyncEngine* engine = arg;
+
+    gsheet_mutex_lock(&engine->mutex);
+    while (!engine->stop_requested) {
+        uint64_t now = gsheet_now_ms();
+        uint64_t next_wake = now + engine->interval_ms;
+        GSheetSyncSheet* due = NULL;
+
+        for (size_t i = 0; i < engine->sheet_count; i++) {
+            GSheetSyncSheet* sheet = engine->sheets[i];
+            if (sheet->next_poll_ms <= now) {
+                if (!due || sheet->next_poll_ms < due->next_poll_ms) due = sheet;
+            }
+            else if (sheet->next_poll_ms < next_wake) {
+                next_wake = sheet->next_poll_ms;
+            }
+        }
+
+        if (!due) {
+            gsheet_cond_timedwait(&engine->cond, &engine->mutex, next_wake - now);
+            continue;
+        }
+
+        // Листы не удаляются, пока поток работает, поэтому опрашиваем без блокировки
+        due->next_poll_ms = now + engine->interval_ms + sync_jitter(engine, due);
+        gsheet_mutex_unlock(&engine->mutex);
+        sync_poll_sheet(engine, due);
+        gsheet_mutex_lock(&engine->mutex);
+    }
+    gsheet_mutex_unlock(&engine->mutex);
+}
+
+GSheetSyncEngine* gsheet_sync_create(uint64_t interval_ms, uint64_t jitter_ms,
+                                     GSheetSyncCallback callback, void* userdata) {
+    if (!callback) return NULL;
+
+    GSheetSyncEngine* engine = calloc(1, sizeof(GSheetSyncEngine));
+    if (!engine) return NULL;
+    engine->interval_ms = interval_ms ? interval_ms : 1000;
+    engine->jitter_ms = jitter_ms;
+    engine->callback = callback;
+    engine->userdata = userdata;
+    gsheet_mutex_init(&engine->mutex);
+    gsheet_cond_init(&engine->cond);
+    return engine;
+}
+
+// Добавить диапазон для отслеживания. Первый опрос размазан джиттером,
+// чтобы сотни листов, добавленных разом, не опрашивались одновременно
+bool gsheet_sync_add(GSheetSyncEngine* engine, GSheetClient* client, const char* range) {
+    if (!engine || !client || !range) return false;
+
+    GSheetSyncSheet* sheet = calloc(1, sizeof(GSheetSyncSheet));
+    if (!sheet) return false;
+    sheet->client = client;
+    sheet->range = strdup(range);
+    if (!sheet->range) {
+        free(sheet);
+        return false;
+    }
+
+    gsheet_mutex_lock(&engine->mutex);
+    if (engine->sheet_count == engine->sheet_capacity) {
+        size_t capacity = engine->sheet_capacity ? engine->sheet_capacity * 2 : 8;
+        GSheetSyncSheet** sheets = realloc(engine->sheets, sizeof(GSheetSyncSheet*) * capacity);
+        if (!sheets) {
+            gsheet_mutex_unlock(&engine->mutex);
+            free(sheet->range);
+            free(sheet);
+            return false;
+        }
+        engine->sheets = sheets;
+        engine->sheet_capacity = capacity;
+    }
+    sheet->rng_state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)engine->sheet_count << 32) ^ gsheet_now_ms();
+    if (sheet->rng_state == 0) sheet->rng_state = 1;
+    sheet->next_poll_ms = gsheet_now_ms() + sync_jitter(engine, sheet);
+    engine->sheets[engine->sheet_count++] = sheet;
+    gsheet_cond_signal(&engine->cond);
+    gsheet_mutex_unlock(&engine->mutex);
+    return true;
+}
+
+bool gsheet_sync_start(GSheetSyncEngine* engine) {
+    if (!engine || engine->running) return false;
+    engine->stop_requested = 0;
+    if (!gsheet_thread_create(&engine->thread, sync_worker, engine)) {
+        fprintf(stderr, "Failed to start sync thread\n");
+        return false;
+    }
+    engine->running = 1;
+    return true;
+}
+
+// Останавливает поток; текущий опрос листа дорабатывает до конца
+void gsheet_sync_stop(GSheetSyncEngine* engine) {
+    if (!engine || !engine->running) return;
+    gsheet_mutex_lock(&engine->mutex);
+    engine->stop_requested = 1;
+    gsheet_cond_broadcast(&engine->cond);
+    gsheet_mutex_unlock(&engine->mutex);
+    gsheet_thread_join(engine->thread);
+    engine->running = 0;
+}
+
+void gsheet_sync_free(GSheetSyncEngine* engine) {
+    if (!engine) return;
+    gsheet_sync_stop(engine);
+    for (size_t i = 0; i < engine->sheet_count; i++) {
+        free(engine->sheets[i]->range);
+        free(engine->sheets[i]->row_hashes);
+        free(engine->sheets[i]);
+    }
+    free(engine->sheets);
+    gsheet_cond_destroy(&engine->cond);
+    gsheet_mutex_destroy(&engine->mutex);
+    free(engine);
+}
+
+// 22. Метрики и логирование
+void gsheet_set_verbose(GSheetClient* client, bool enabled) {
+    if (!client) return;
+    gsheet_atomic_store(&client->verbose, enabled ? 1 : 0);
+}
+
+// Счётчики читаются по одному, без остановки писателей: снимок согласован
+// по каждому счётчику, но не между ними
+void gsheet_metrics_snapshot(GSheetClient* client, GSheetMetricsSnapshot* out) {
+    if (!client || !out) return;
+    const GSheetMetrics* metrics = &client->metrics;
+
+    for (size_t t = 0; t < GSHEET_TIMER_COUNT; t++) {
+        for (size_t b = 0; b < GSHEET_HISTOGRAM_BUCKETS; b++) {
+            out->buckets[t][b] = gsheet_atomic_load(&metrics->timers[t].buckets[b]);
+        }
+        out->count[t] = gsheet_atomic_load(&metrics->timers[t].count);
+        out->sum_us[t] = gsheet_atomic_load(&metrics->timers[t].sum_us);
+    }
+    out->requests = gsheet_atomic_load(&metrics->requests);
+    out->errors = gsheet_atomic_load(&metrics->errors);
+    out->retries = gsheet_atomic_load(&metrics->retries);
+    out->bytes_in = gsheet_atomic_load(&metrics->bytes_in);
+    out->bytes_out = gsheet_atomic_load(&metrics->bytes_out);
+    out->allocations = gsheet_atomic_load(&metrics->allocations);
+}
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} MetricsText;
+
+static void metrics_printf(MetricsText* text, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        size_t available = text->cap - text->len;
+        va_start(args, format);
+        int written = vsnprintf(text->data ? text->data + text->len : NULL, available, format, args);
+        va_end(args);
+        if (written < 0) return;
+        if ((size_t)written < available) {
+            text->len += (size_t)written;
+            return;
+        }
+        size_t cap = text->cap ? text->cap * 2 : 4096;
+        while (cap - text->len <= (size_t)written) cap *= 2;
+        char* data = realloc(text->data, cap);
+        if (!data) return;
+        text->data = data;
+        text->cap = cap;
+    }
+}
+
+// Текстовый формат Prometheus. Строку освобождает вызывающий код (free)
+char* gsheet_metrics_prometheus(GSheetClient* client) {
+    static const char* timer_names[GSHEET_TIMER_COUNT] = {
+        "gsheet_dns_seconds",
+        "gsheet_connect_seconds",
+        "gsheet_tls_seconds",
+        "gsheet_ttfb_seconds",
+        "gsheet_request_seconds",
+        "gsheet_json_parse_seconds",
+        "gsheet_range_build_seconds"
+    };
+    static const char* timer_help[GSHEET_TIMER_COUNT] = {
+        "DNS resolution time",
+        "TCP connect time",
+        "TLS handshake time",
+        "Time to first byte",
+        "Total request time",
+        "JSON parse time",
+        "SheetRange build time"
+    };
+
+    if (!client) return NULL;
+    GSheetMetricsSnapshot* snapshot = malloc(sizeof(GSheetMetricsSnapshot));
+    if (!snapshot) return NULL;
+    gsheet_metrics_snapshot(client, snapshot);
+
+    MetricsText text = { NULL, 0, 0 };
+    const char* id = client->spreadsheet_id;
+
+    for (size_t t = 0; t < GSHEET_TIMER_COUNT; t++) {
+        metrics_printf(&text, "# HELP %s %s\n# TYPE %s histogram\n",
+            timer_names[t], timer_help[t], timer_names[t]);
+
+        // Корзины в Prometheus кумулятивные
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < GSHEET_HISTOGRAM_BUCKETS - 1; b++) {
+            cumulative += snapshot->buckets[t][b];
+            metrics_printf(&text, "%s_bucket{spreadsheet_id=\"%s\",le=\"%.6f\"} %llu\n",
+                timer_names[t], id, (double)((uint64_t)1 << b) / 1e6, (unsigned long long)cumulative);
+        }
+        metrics_printf(&text, "%s_bucket{spreadsheet_id=\"%s\",le=\"+Inf\"} %llu\n",
+            timer_names[t], id, (unsigned long long)snapshot->count[t]);
+        metrics_printf(&text, "%s_sum{spreadsheet_id=\"%s\"} %.6f\n",
+            timer_names[t], id, (double)snapshot->sum_us[t] / 1e6);
+        metrics_printf(&text, "%s_count{spreadsheet_id=\"%s\"} %llu\n",
+            timer_names[t], id, (unsigned long long)snapshot->count[t]);
+    }
+
+    const struct {
+        const char* name;
+        const char* help;
+        uint64_t value;
+    } counters[] = {
+        { "gsheet_requests_total", "HTTP requests performed", snapshot->requests },
+        { "gsheet_request_errors_total", "Failed HTTP requests", snapshot->errors },
+        { "gsheet_retries_total", "Retried HTTP requests", snapshot->retries },
+        { "gsheet_received_bytes_total", "Response body bytes", snapshot->bytes_in },
+        { "gsheet_sent_bytes_total", "Request body bytes", snapshot->bytes_out },
+        { "gsheet_allocations_total", "Allocations made through the client allocator", snapshot->allocations }
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        metrics_printf(&text, "# HELP %s %s\n# TYPE %s counter\n%s{spreadsheet_id=\"%s\"} %llu\n",
+            counters[i].name, counters[i].help, counters[i].name,
+            counters[i].name, id, (unsigned long long)counters[i].value);
+    }
+
+    free(snapshot);
+    return text.data;
+}
+
+// 23. Аллокаторы
+// NULL возвращает клиента к malloc/free. Менять аллокатор можно только
+// между запросами: SheetRange запоминают аллокатор, которым выделены
+void gsheet_set_allocator(GSheetClient* client, const GSheetAllocator* allocator) {
+    if (!client) return;
+    if (allocator) {
+        client->allocator = *allocator;
+    }
+    else {
+        memset(&client->allocator, 0, sizeof(GSheetAllocator));
+    }
+    // malloc потокобезопасен сам, пользовательский аллокатор закрываем мьютексом
+    client->shared_scope.allocator = client->allocator.malloc_fn
+        ? &client->locked_allocator : &client->allocator;
+}
+
+void gsheet_set_cjson_hooks(const cJSON_Hooks* hooks) {
+    fallback_malloc = hooks && hooks->malloc_fn ? hooks->malloc_fn : malloc;
+    fallback_free = hooks && hooks->free_fn ? hooks->free_fn : free;
+    gsheet_once(&cjson_hooks_once, install_cjson_hooks);
+}
+
+// Bump-арена: выделение - сдвиг указателя, free ничего не делает,
+// все временные данные запроса освобождаются одним gsheet_arena_reset.
+// Арена не потокобезопасна: одна арена на поток или на запрос
+#define GSHEET_ARENA_ALIGN 16
+
+typedef struct GSheetArenaBlock {
+    struct GSheetArenaBlock* next;
+    size_t capacity;
+    size_t used;
+} GSheetArenaBlock;
+
+typedef struct GSheetArena {
+    GSheetArenaBlock* head;   // текущий блок, остальные - по цепочке next
+    size_t block_size;
+} GSheetArena;
+
+static size_t arena_align(size_t size) {
+    return (size + GSHEET_ARENA_ALIGN - 1) & ~(size_t)(GSHEET_ARENA_ALIGN - 1);
+}
+
+// Данные блока начинаются после выровненного заголовка
+static unsigned char* arena_block_data(GSheetArenaBlock* block) {
+    return (unsigned char*)block + arena_align(sizeof(GSheetArenaBlock));
+}
+
+static GSheetArenaBlock* arena_new_block(size_t capacity) {
+    GSheetArenaBlock* block = malloc(arena_align(sizeof(GSheetArenaBlock)) + capacity);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+// Перед каждым выделением храним его размер - он нужен для realloc
+static void* arena_malloc(void* ctx, size_t size) {
+    GSheetArena* arena = ctx;
+    const size_t need = GSHEET_ARENA_ALIGN + arena_align(size);
+    GSheetArenaBlock* block = arena->head;
+
+    if (!block || block->capacity - block->used < need) {
+        block = arena_new_block(arena->block_size > need ? arena->block_size : need);
+        if (!block) return NULL;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    unsigned char* header = arena_block_data(block) + block->used;
+    *(size_t*)header = size;
+    block->used += need;
+    return header + GSHEET_ARENA_ALIGN;
+}
+
+static void* arena_realloc(void* ctx, void* ptr, size_t size) {
+    GSheetArena* arena = ctx;
+    if (!ptr) return arena_malloc(ctx, size);
+
+    unsigned char* header = (unsigned char*)ptr - GSHEET_ARENA_ALIGN;
+    const size_t old_size = *(size_t*)header;
+    if (size <= old_size) return ptr;
+
+    // Последнее выделение в текущем блоке растёт на месте
+    GSheetArenaBlock* block = arena->head;
+    unsigned char* end = arena_block_data(block) + block->used;
+    const size_t grow = arena_align(size) - arena_align(old_size);
+    if ((unsigned char*)ptr + arena_align(old_size) == end && block->capacity - block->used >= grow) {
+        block->used += grow;
+        *(size_t*)header = size;
+        return ptr;
+    }
+
+    void* copy = arena_malloc(ctx, size);
+    if (copy) memcpy(copy, ptr, old_size);
+    return copy;
+}
+
+static void arena_free(void* ctx, void* ptr) {
+    (void)ctx;
+    (void)ptr;
+}
+
+GSheetArena* gsheet_arena_create(size_t block_size) {
+    GSheetArena* arena = calloc(1, sizeof(GSheetArena));
+    if (!arena) return NULL;
+    arena->block_size = block_size ? arena_align(block_size) : 64 * 1024;
+    return arena;
+}
+
+// Освобождает всё выделенное в арене. Если понадобилось несколько блоков,
+// они сливаются в один общего размера, чтобы следующий такой же запрос
+// уложился в арену без обращений к malloc
+void gsheet_arena_reset(GSheetArena* arena) {
+    if (!arena || !arena->head) return;
+
+    if (!arena->head->next) {
+        arena->head->used = 0;
+        return;
+    }
+
+    size_t total = 0;
+    GSheetArenaBlock* block = arena->head;
+    while (block) {
+        GSheetArenaBlock* next = block->next;
+        total += block->capacity;
+        free(block);
+        block = next;
+    }
+    arena->head = arena_new_block(total);
+    if (arena->head && total > arena->block_size) arena->block_size = total;
+}
+
+void gsheet_arena_destroy(GSheetArena* arena) {
+    if (!arena) return;
+    GSheetArenaBlock* block = arena->head;
+    while (block) {
+        GSheetArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+GSheetAllocator gsheet_arena_allocator(GSheetArena* arena) {
+    GSheetAllocator allocator = { arena_malloc, arena_realloc, arena_free, arena };
+    return allocator;
+}
+
+// 24. Размер сетки листа (rowCount x columnCount) из метаданных таблицы
+bool gsheet_get_grid_size(GSheetClient* client, const char* sheet_title, size_t* rows, size_t* cols) {
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    long http_code = 0;
+    char url[512];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s?fields=sheets.properties(title,gridProperties)",
+        client->spreadsheet_id);
+
+    bool found = false;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (!connection) {
+        gsheet_alloc_leave(previous_scope);
+        return false;
+    }
+    CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+
+    if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+        cJSON* json = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        cJSON* sheet = NULL;
+        cJSON_ArrayForEach(sheet, cJSON_GetObjectItem(json, "sheets")) {
+            cJSON* props = cJSON_GetObjectItem(sheet, "properties");
+            const char* title = cJSON_GetStringValue(cJSON_GetObjectItem(props, "title"));
+            if (!title || strcmp(title, sheet_title) != 0) continue;
+
+            cJSON* grid = cJSON_GetObjectItem(props, "gridProperties");
+            cJSON* row_count = cJSON_GetObjectItem(grid, "rowCount");
+            cJSON* col_count = cJSON_GetObjectItem(grid, "columnCount");
+            if (cJSON_IsNumber(row_count) && cJSON_IsNumber(col_count)) {
+                *rows = (size_t)row_count->valuedouble;
+                *cols = (size_t)col_count->valuedouble;
+                found = true;
+            }
+            break;
+        }
+        cJSON_Delete(json);
+    }
+
+    gsheet_connection_release(client, connection);
+    gsheet_alloc_leave(previous_scope);
+    return found;
+}
+
+// 25. Параллельное чтение всего листа полосами строк
+//
+// Лист делится на полосы по band_rows строк ("'Лист'!1:1000", "'Лист'!1001:2000", ...).
+// Рабочие потоки забирают полосы по атомарному счётчику, каждый берёт
+// keep-alive соединение из пула клиента (DNS и TLS-сессии общие через CURLSH),
+// разбирает ответ у себя и пишет строки сразу в их слоты общей таблицы - без слияния.
+
+typedef struct {
+    GSheetClient* client;
+    const char* escaped_title;
+    SheetRange* result;
+    size_t band_rows;
+    size_t band_count;
+    volatile uint64_t next_band;
+    volatile uint64_t failed;
+    volatile uint64_t max_cols;   // фактическая ширина данных
+    volatile uint64_t max_row;    // 1 + индекс последней непустой строки
+    const GSheetAllocScope* scope;
+    CURLSH* share;
+    gsheet_mutex_t share_locks[CURL_LOCK_DATA_LAST];  // по мьютексу на тип общих данных
+} ShardedRead;
+
+static void share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    ShardedRead* job = userptr;
+    (void)handle; (void)access;
+    gsheet_mutex_lock(&job->share_locks[data]);
+}
+
+static void share_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+    ShardedRead* job = userptr;
+    (void)handle;
+    gsheet_mutex_unlock(&job->share_locks[data]);
+}
+
+// DNS и TLS-сессии общие: новые соединения рабочих потоков не делают
+// полный TLS handshake, если другой поток уже подключился
+static CURLSH* sharded_share_create(ShardedRead* job) {
+    CURLSH* share = curl_share_init();
+    if (!share) return NULL;
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) gsheet_mutex_init(&job->share_locks[i]);
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, job);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return share;
+}
+
+static void sharded_share_free(ShardedRead* job) {
+    if (!job->share) return;
+    curl_share_cleanup(job->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) gsheet_mutex_destroy(&job->share_locks[i]);
+}
+
+static void atomic_max(volatile uint64_t* target, uint64_t value) {
+    uint64_t current = gsheet_atomic_load(target);
+    while (current < value && !gsheet_atomic_cas(target, current, value)) {
+        current = gsheet_atomic_load(target);
+    }
+}
+
+// Разбор одной полосы: строки кладутся в result->data[first_row + k]
+// Ячейки - как у gsheet_read_range; ответ с ошибкой проваливает всё чтение
+static int sharded_fill_band(ShardedRead* job, const GSheetBuffer* body, size_t first_row) {
+    cJSON* root = cJSON_ParseWithLength(body->data, body->len);
+    cJSON* values = NULL;
+    if (!gsheet_response_values(job->client, root, &values)) {
+        cJSON_Delete(root);
+        return 0;
+    }
+
+    SheetRange* result = job->result;
+    cJSON* row = NULL;
+    size_t i = first_row;
+    size_t band_cols = 0;
+    size_t last_row = 0;
+    int ok = 1;
+
+    cJSON_ArrayForEach(row, values) {
+        if (i >= result->rows || i >= first_row + job->band_rows) break;
+
+        char** cells = gsheet_malloc(sizeof(char*) * result->cols);
+        if (!cells) {
+            ok = 0;
+            break;
+        }
+        memset(cells, 0, sizeof(char*) * result->cols);
+
+        size_t j = 0;
+        cJSON* row_cells = cJSON_IsArray(row) ? row : NULL;
+        cJSON* cell = NULL;
+        cJSON_ArrayForEach(cell, row_cells) {
+            if (j >= result->cols) break;
+            cells[j++] = sheet_cell_take_text(cell);
+        }
+        if (j > 0) last_row = i + 1;
+        if (j > band_cols) band_cols = j;
+        result->data[i++] = cells;
+    }
+
+    cJSON_Delete(root);
+    atomic_max(&job->max_cols, band_cols);
+    atomic_max(&job->max_row, last_row);
+    return ok;
+}
+
+static void sharded_worker(void* arg) {
+    ShardedRead* job = arg;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(job->scope);
+    GSheetConnection* connection = gsheet_connection_acquire(job->client);
+    if (!connection) {
+        gsheet_atomic_store(&job->failed, 1);
+        gsheet_alloc_leave(previous_scope);
+        return;
+    }
+    connection->share = job->share;
+
+    for (;;) {
+        const uint64_t band = gsheet_atomic_add(&job->next_band, 1);
+        if (band >= job->band_count || gsheet_atomic_load(&job->failed)) break;
+
+        const size_t first_row = (size_t)band * job->band_rows;
+        size_t last_row = first_row + job->band_rows;
+        if (last_row > job->result->rows) last_row = job->result->rows;
+
+        char url[1024];
+        long http_code = 0;
+        snprintf(url, sizeof(url),
+            "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s!%zu:%zu",
+            job->client->spreadsheet_id, job->escaped_title, first_row + 1, last_row);
+
+        CURLcode res = gsheet_http_request(job->client, connection, "GET", url, NULL, &http_code);
+        if (res != CURLE_OK || http_code != 200 || !sharded_fill_band(job, &connection->body, first_row)) {
+            gsheet_atomic_store(&job->failed, 1);
+            break;
+        }
+    }
+
+    // CURLSH освобождается после чтения, соединение уходит в пул клиента без него
+    curl_easy_setopt(connection->curl, CURLOPT_SHARE, NULL);
+    connection->share = NULL;
+    gsheet_connection_release(job->client, connection);
+    gsheet_alloc_leave(previous_scope);
+}
+
+// band_rows == 0 - 5000 строк, concurrency <= 0 - 4 потока
+SheetRange* gsheet_read_sheet_sharded(GSheetClient* client, const char* sheet_title,
+                                      size_t band_rows, int concurrency) {
+    size_t grid_rows = 0, grid_cols = 0;
+    if (!client || !sheet_title) return NULL;
+    if (!gsheet_get_grid_size(client, sheet_title, &grid_rows, &grid_cols)) {
+        fprintf(stderr, "Cannot get grid size of sheet %s\n", sheet_title);
+        return NULL;
+    }
+    if (band_rows == 0) band_rows = 5000;
+    if (concurrency <= 0) concurrency = 4;
+
+    // Рабочие потоки выделяют память параллельно
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->shared_scope);
+
+    // Таблица результата выделяется сразу на весь лист
+    SheetRange* result = gsheet_malloc(sizeof(SheetRange));
+    char*** data = grid_rows ? gsheet_malloc(sizeof(char**) * grid_rows) : NULL;
+    if (!result || (grid_rows && !data)) {
+        gsheet_mem_free(data);
+        gsheet_mem_free(result);
+        gsheet_alloc_leave(previous_scope);
+        return NULL;
+    }
+    if (data) memset(data, 0, sizeof(char**) * grid_rows);
+    memset(result, 0, sizeof(SheetRange));
+    result->data = data;
+    result->rows = grid_rows;
+    result->cols = grid_cols;
+    result->allocator = client->allocator;
+    // Полосы заполняются параллельно, поэтому каждая строка - своё выделение
+    result->row_block = false;
+
+    // Имя листа в A1 берём в кавычки ('' внутри): пробелы, '!', апострофы и
+    // имена вида "A1" без них дают чужой диапазон или 400
+    const size_t title_len = strlen(sheet_title);
+    char* quoted = malloc(title_len * 2 + 3);
+    char* escaped_title = NULL;
+    if (quoted) {
+        size_t pos = 0;
+        quoted[pos++] = '\'';
+        for (size_t k = 0; k < title_len; k++) {
+            if (sheet_title[k] == '\'') quoted[pos++] = '\'';
+            quoted[pos++] = sheet_title[k];
+        }
+        quoted[pos++] = '\'';
+        quoted[pos] = '\0';
+        escaped_title = curl_easy_escape(NULL, quoted, 0);
+        free(quoted);
+    }
+    ShardedRead job;
+    memset(&job, 0, sizeof(job));
+    job.client = client;
+    job.escaped_title = escaped_title;
+    job.result = result;
+    job.band_rows = band_rows;
+    job.band_count = (grid_rows + band_rows - 1) / band_rows;
+    job.scope = &client->shared_scope;
+    job.share = sharded_share_create(&job);
+
+    size_t worker_count = (size_t)concurrency < job.band_count ? (size_t)concurrency : job.band_count;
+    gsheet_thread_t* threads = calloc(worker_count ? worker_count : 1, sizeof(gsheet_thread_t));
+    size_t started = 0;
+    if (!escaped_title || !threads) {
+        job.failed = 1;
+    }
+    else {
+        for (; started < worker_count; started++) {
+            if (!gsheet_thread_create(&threads[started], sharded_worker, &job)) break;
+        }
+        // Если ни один поток не стартовал, работаем в текущем
+        if (started == 0 && job.band_count > 0) sharded_worker(&job);
+    }
+    for (size_t t = 0; t < started; t++) {
+        gsheet_thread_join(threads[t]);
+    }
+    free(threads);
+    curl_free(escaped_title);
+    sharded_share_free(&job);
+
+    if (job.failed) {
+        fprintf(stderr, "Sharded read of %s failed\n", sheet_title);
+        for (size_t i = 0; i < grid_rows; i++) {
+            if (!result->data[i]) continue;
+            for (size_t j = 0; j < grid_cols; j++) gsheet_mem_free(result->data[i][j]);
+            gsheet_mem_free(result->data[i]);
+        }
+        gsheet_mem_free(result->data);
+        gsheet_mem_free(result);
+        gsheet_alloc_leave(previous_scope);
+        return NULL;
+    }
+
+    // Обрезаем пустой хвост сетки и заполняем пропуски пустыми строками
+    const size_t used_rows = (size_t)job.max_row;
+    const size_t used_cols = (size_t)job.max_cols;
+    for (size_t i = used_rows; i < grid_rows; i++) {
+        if (!result->data[i]) continue;
+        for (size_t j = 0; j < grid_cols; j++) gsheet_mem_free(result->data[i][j]);
+        gsheet_mem_free(result->data[i]);
+        result->data[i] = NULL;
+    }
+    result->rows = used_rows;
+
+    for (size_t i = 0; i < used_rows; i++) {
+        if (!result->data[i]) {
+            result->data[i] = gsheet_malloc(sizeof(char*) * grid_cols);
+            memset(result->data[i], 0, sizeof(char*) * grid_cols);
+        }
+        for (size_t j = 0; j < used_cols; j++) {
+            if (!result->data[i][j]) result->data[i][j] = gsheet_strdup("");
+        }
+    }
+    // Ячейки правее used_cols всегда NULL, gsheet_free_range их не трогает
+    result->cols = used_cols;
+
+    gsheet_alloc_leave(previous_scope);
+    return result;
+}
+
+// 26. Пул задач с перехватом работы (work stealing)
+//
+// Запрос проходит стадии BUILD (сборка JSON) -> IO (HTTP) -> PARSE (разбор
+// ответа и сборка SheetRange) -> POST (колбэк пользователя), каждая стадия -
+// отдельная задача. Пока один поток ждёт сеть для запроса N, другие собирают
+// тело запроса N+1 и разбирают ответ N-1. У каждого рабочего потока своя
+// очередь: следующую стадию он кладёт себе и берёт с хвоста (данные ещё в
+// кэше), а простаивающие потоки забирают задачи с головы чужих очередей.
+
+typedef struct GSheetTask {
+    void (*run)(struct GSheetTask* task);
+    GSheetStage stage;
+    uint64_t enqueued_us;
+} GSheetTask;
+
+// Кольцевая очередь задач: владелец работает с хвостом, воры - с головы
+typedef struct {
+    gsheet_mutex_t mutex;
+    GSheetTask** items;
+    size_t head;
+    size_t count;
+    size_t cap;
+} TaskDeque;
+
+typedef struct {
+    volatile uint64_t submitted;
+    volatile uint64_t completed;
+    volatile uint64_t wait_us;   // суммарное время в очереди
+    volatile uint64_t run_us;    // суммарное время выполнения
+} GSheetStageCounters;
+
+typedef struct {
+    struct GSheetPool* pool;
+    size_t index;
+} PoolWorker;
+
+typedef struct GSheetPool {
+    size_t worker_count;
+    gsheet_thread_t* threads;
+    PoolWorker* workers;
+    size_t started;
+    // worker_count очередей рабочих потоков + общая очередь для внешних потоков
+    TaskDeque* deques;
+    gsheet_mutex_t sleep_mutex;
+    gsheet_cond_t wake;
+    volatile uint64_t pending;   // задач в очередях
+    volatile uint64_t stopping;
+    volatile uint64_t steals;
+    GSheetStageCounters stages[GSHEET_STAGE_COUNT];
+} GSheetPool;
+
+// Пул и номер очереди текущего рабочего потока (NULL вне пула)
+static GSHEET_THREAD_LOCAL PoolWorker* current_worker = NULL;
+
+static int task_deque_push(TaskDeque* deque, GSheetTask* task) {
+    int ok = 1;
+    gsheet_mutex_lock(&deque->mutex);
+    if (deque->count == deque->cap) {
+        size_t cap = deque->cap ? deque->cap * 2 : 64;
+        GSheetTask** items = malloc(sizeof(GSheetTask*) * cap);
+        if (items) {
+            for (size_t i = 0; i < deque->count; i++) {
+                items[i] = deque->items[(deque->head + i) % deque->cap];
+            }
+            free(deque->items);
+            deque->items = items;
+            deque->head = 0;
+            deque->cap = cap;
+        }
+        else {
+            ok = 0;
+        }
+    }
+    if (ok) {
+        deque->items[(deque->head + deque->count) % deque->cap] = task;
+        deque->count++;
+    }
+    gsheet_mutex_unlock(&deque->mutex);
+    return ok;
+}
+
+// Владелец: последняя добавленная задача
+static GSheetTask* task_deque_pop(TaskDeque* deque) {
+    GSheetTask* task = NULL;
+    gsheet_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        deque->count--;
+        task = deque->items[(deque->head + deque->count) % deque->cap];
+    }
+    gsheet_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+// Вор: самая старая задача
+static GSheetTask* task_deque_steal(TaskDeque* deque) {
+    GSheetTask* task = NULL;
+    gsheet_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        task = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->cap;
+        deque->count--;
+    }
+    gsheet_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+// Без пула задача выполняется сразу в текущем потоке
+static void gsheet_pool_submit(GSheetPool* pool, GSheetTask* task) {
+    if (pool) {
+        gsheet_atomic_add(&pool->stages[task->stage].submitted, 1);
+    }
+    task->enqueued_us = gsheet_now_us();
+
+    // Из рабочего потока - в свою очередь, иначе - в общую
+    size_t index = pool ? pool->worker_count : 0;
+    if (pool && current_worker && current_worker->pool == pool) {
+        index = current_worker->index;
+    }
+    // pending растёт до push: иначе рабочий поток успевает забрать задачу
+    // и уменьшить счётчик раньше, и тот на миг переходит через ноль
+    if (pool) gsheet_atomic_add(&pool->pending, 1);
+    if (!pool || !task_deque_push(&pool->deques[index], task)) {
+        if (pool) gsheet_atomic_add(&pool->pending, (uint64_t)-1);
+        // Задача может освободить себя в run
+        const GSheetStage stage = task->stage;
+        const uint64_t start = gsheet_now_us();
+        task->run(task);
+        if (pool) {
+            gsheet_atomic_add(&pool->stages[stage].run_us, gsheet_now_us() - start);
+            gsheet_atomic_add(&pool->stages[stage].completed, 1);
+        }
+        return;
+    }
+
+    gsheet_mutex_lock(&pool->sleep_mutex);
+    gsheet_cond_signal(&pool->wake);
+    gsheet_mutex_unlock(&pool->sleep_mutex);
+}
+
+static GSheetTask* pool_find_task(GSheetPool* pool, size_t self) {
+    GSheetTask* task = task_deque_pop(&pool->deques[self]);
+    const size_t deque_count = pool->worker_count + 1;
+    for (size_t k = 1; !task && k < deque_count; k++) {
+        const size_t victim = (self + k) % deque_count;
+        task = task_deque_steal(&pool->deques[victim]);
+        // Общая очередь - обычный источник работы, а не кража
+        if (task && victim != pool->worker_count) gsheet_atomic_add(&pool->steals, 1);
+    }
+    if (task) gsheet_atomic_add(&pool->pending, (uint64_t)-1);
+    return task;
+}
+
+static void pool_worker(void* arg) {
+    PoolWorker* worker = arg;
+    GSheetPool* pool = worker->pool;
+    current_worker = worker;
+
+    for (;;) {
+        GSheetTask* task = pool_find_task(pool, worker->index);
+        if (!task) {
+            // Пул останавливается только после того, как очереди опустели
+            int stop = 0;
+            gsheet_mutex_lock(&pool->sleep_mutex);
+            while (gsheet_atomic_load(&pool->pending) == 0 && !gsheet_atomic_load(&pool->stopping)) {
+                gsheet_cond_wait(&pool->wake, &pool->sleep_mutex);
+            }
+            stop = gsheet_atomic_load(&pool->pending) == 0;
+            gsheet_mutex_unlock(&pool->sleep_mutex);
+            if (stop) break;
+            continue;
+        }
+
+        // stage читаем до run: задача может переставить себя на следующую стадию
+        GSheetStageCounters* counters = &pool->stages[task->stage];
+        const uint64_t start = gsheet_now_us();
+        gsheet_atomic_add(&counters->wait_us, start - task->enqueued_us);
+        task->run(task);
+        gsheet_atomic_add(&counters->run_us, gsheet_now_us() - start);
+        gsheet_atomic_add(&counters->completed, 1);
+    }
+
+    current_worker = NULL;
+}
+
+static size_t gsheet_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+#endif
+}
+
+void gsheet_pool_destroy(GSheetPool* pool);
+
+// worker_count == 0 - по числу процессоров
+GSheetPool* gsheet_pool_create(size_t worker_count) {
+    if (worker_count == 0) worker_count = gsheet_cpu_count();
+
+    GSheetPool* pool = calloc(1, sizeof(GSheetPool));
+    if (!pool) return NULL;
+    pool->worker_count = worker_count;
+    pool->threads = calloc(worker_count, sizeof(gsheet_thread_t));
+    pool->workers = calloc(worker_count, sizeof(PoolWorker));
+    pool->deques = calloc(worker_count + 1, sizeof(TaskDeque));
+    if (!pool->threads || !pool->workers || !pool->deques) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    for (size_t i = 0; i <= worker_count; i++) gsheet_mutex_init(&pool->deques[i].mutex);
+    gsheet_mutex_init(&pool->sleep_mutex);
+    gsheet_cond_init(&pool->wake);
+
+    for (; pool->started < worker_count; pool->started++) {
+        PoolWorker* worker = &pool->workers[pool->started];
+        worker->pool = pool;
+        worker->index = pool->started;
+        if (!gsheet_thread_create(&pool->threads[pool->started], pool_worker, worker)) break;
+    }
+    // Очереди не стартовавших потоков остаются пустыми: в них кладёт только владелец
+    if (pool->started == 0) {
+        fprintf(stderr, "Cannot start pool workers\n");
+        gsheet_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Дожидается выполнения всех поставленных задач (включая их следующие стадии)
+void gsheet_pool_destroy(GSheetPool* pool) {
+    if (!pool) return;
+    // Из задачи самого пула join ждал бы собственный поток
+    if (current_worker && current_worker->pool == pool) {
+        fprintf(stderr, "gsheet_pool_destroy called from a pool worker, pool is not destroyed\n");
+        return;
+    }
+
+    gsheet_mutex_lock(&pool->sleep_mutex);
+    gsheet_atomic_store(&pool->stopping, 1);
+    gsheet_cond_broadcast(&pool->wake);
+    gsheet_mutex_unlock(&pool->sleep_mutex);
+
+    for (size_t i = 0; i < pool->started; i++) {
+        gsheet_thread_join(pool->threads[i]);
+    }
+    for (size_t i = 0; i <= pool->worker_count; i++) {
+        gsheet_mutex_destroy(&pool->deques[i].mutex);
+        free(pool->deques[i].items);
+    }
+    gsheet_cond_destroy(&pool->wake);
+    gsheet_mutex_destroy(&pool->sleep_mutex);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+// Размер пула и очереди по стадиям; avg ожидания = wait_us / completed
+void gsheet_pool_stats(GSheetPool* pool, GSheetPoolStats* out) {
+    if (!pool || !out) return;
+    out->workers = pool->started;
+    out->steals = gsheet_atomic_load(&pool->steals);
+    for (size_t s = 0; s < GSHEET_STAGE_COUNT; s++) {
+        GSheetStageStats* stage = &out->stages[s];
+        stage->completed = gsheet_atomic_load(&pool->stages[s].completed);
+        stage->submitted = gsheet_atomic_load(&pool->stages[s].submitted);
+        stage->queued = stage->submitted > stage->completed ? stage->submitted - stage->completed : 0;
+        stage->wait_us = gsheet_atomic_load(&pool->stages[s].wait_us);
+        stage->run_us = gsheet_atomic_load(&pool->stages[s].run_us);
+    }
+}
+
+// Пул может обслуживать несколько клиентов и должен пережить их запросы;
+// NULL возвращает *_async к синхронному выполнению
+void gsheet_attach_pool(GSheetClient* client, GSheetPool* pool) {
+    if (!client) return;
+    client->pool = pool;
+}
+
+// Асинхронный запрос: одна задача, которая переставляет себя по стадиям
+typedef struct {
+    GSheetTask task;
+    GSheetClient* client;
+    GSheetPool* pool;                // пул на момент постановки: отвязка не задевает начатые запросы
+    char url[1024];
+    const SheetRange* data;          // запись: данные, до стадии BUILD включительно
+    char* payload;
+    GSheetConnection* connection;    // держим от IO до PARSE: тело ответа в его буфере
+    CURLcode res;
+    long http_code;
+    SheetRange* result;
+    GSheetReadCallback on_read;
+    GSheetWriteCallback on_write;
+    void* userdata;
+} AsyncRequest;
+
+static void async_request_next(AsyncRequest* request, GSheetStage stage) {
+    request->task.stage = stage;
+    gsheet_pool_submit(request->pool, &request->task);
+}
+
+static void async_request_run(GSheetTask* task) {
+    AsyncRequest* request = (AsyncRequest*)task;
+    GSheetClient* client = request->client;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->shared_scope);
+
+    switch (task->stage) {
+    case GSHEET_STAGE_BUILD:
+        request->payload = gsheet_build_values_payload(request->data);
+        request->data = NULL;
+        async_request_next(request, GSHEET_STAGE_IO);
+        break;
+
+    case GSHEET_STAGE_IO:
+        request->connection = gsheet_connection_acquire(client);
+        if (request->connection) {
+            request->res = gsheet_http_request(client, request->connection,
+                request->on_read ? "GET" : "PUT", request->url, request->payload, &request->http_code);
+        }
+        if (request->on_read && request->res == CURLE_OK && request->http_code == 200
+            && request->connection->body.len) {
+            async_request_next(request, GSHEET_STAGE_PARSE);
+        }
+        else {
+            gsheet_connection_release(client, request->connection);
+            request->connection = NULL;
+            async_request_next(request, GSHEET_STAGE_POST);
+        }
+        break;
+
+    case GSHEET_STAGE_PARSE:
+        request->result = gsheet_parse_values(client, &request->connection->body);
+        gsheet_connection_release(client, request->connection);
+        request->connection = NULL;
+        async_request_next(request, GSHEET_STAGE_POST);
+        break;
+
+    case GSHEET_STAGE_POST:
+    default:
+        gsheet_mem_free(request->payload);
+        if (request->on_read) {
+            request->on_read(request->result, request->userdata);
+        }
+        else {
+            bool success = (request->res == CURLE_OK && request->http_code == 200);
+            if (!success) {
+                fprintf(stderr, "Write failed. HTTP Code: %ld\n", request->http_code);
+            }
+            request->on_write(success, request->userdata);
+        }
+        free(request);
+        break;
+    }
+
+    gsheet_alloc_leave(previous_scope);
+}
+
+static AsyncRequest* async_request_create(GSheetClient* client, void* userdata) {
+    AsyncRequest* request = calloc(1, sizeof(AsyncRequest));
+    if (!request) return NULL;
+    request->task.run = async_request_run;
+    request->client = client;
+    request->pool = client->pool;
+    request->res = CURLE_FAILED_INIT;
+    request->userdata = userdata;
+    return request;
+}
+
+// Чтение в пуле: callback получает SheetRange (или NULL при ошибке) в рабочем
+// потоке и освобождает его через gsheet_free_range
+bool gsheet_read_range_async(GSheetClient* client, const char* range,
+                             GSheetReadCallback callback, void* userdata) {
+    if (!client || !range || !callback) return false;
+    AsyncRequest* request = async_request_create(client, userdata);
+    if (!request) return false;
+    snprintf(request->url, sizeof(request->url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s",
+        client->spreadsheet_id, range);
+    request->on_read = callback;
+    async_request_next(request, GSHEET_STAGE_IO);
+    return true;
+}
+
+// Запись в пуле: data должна оставаться неизменной до вызова callback
+bool gsheet_write_range_async(GSheetClient* client, const char* range, const SheetRange* data,
+                              GSheetWriteCallback callback, void* userdata) {
+    if (!client || !range || !data || !callback) return false;
+    AsyncRequest* request = async_request_create(client, userdata);
+    if (!request) return false;
+    snprintf(request->url, sizeof(request->url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s?valueInputOption=RAW",
+        client->spreadsheet_id, range);
+    request->data = data;
+    request->on_write = callback;
+    async_request_next(request, GSHEET_STAGE_BUILD);
+    return true;
+}
+
+// 27. Общий HTTP/2-транспорт для многих клиентов
+//
+// Клиенты (например, по одному на spreadsheet_id) подключаются к одному
+// транспорту: запросы всех клиентов идут через один curl multi, который держит
+// не больше max_connections соединений к хосту и мультиплексирует в них потоки
+// HTTP/2. Вызывающий поток ставит запрос в очередь своего клиента и ждёт
+// завершения; поток транспорта по кругу берёт по одному запросу у каждого
+// клиента (не больше per_client_streams одновременно на клиента), поэтому
+// активный клиент не вытесняет остальных.
+
+typedef struct TransportRequest {
+    CURL* curl;
+    CURLcode result;
+    int done;
+    struct TransportTenant* tenant;
+    struct TransportRequest* next;
+} TransportRequest;
+
+// Клиент транспорта: своя очередь ожидающих запросов и счётчик активных потоков
+typedef struct TransportTenant {
+    TransportRequest* head;
+    TransportRequest* tail;
+    size_t in_flight;
+    struct TransportTenant* next;
+} TransportTenant;
+
+typedef struct GSheetTransport {
+    CURLM* multi;               // трогает только поток транспорта (кроме curl_multi_wakeup)
+    gsheet_thread_t thread;
+    gsheet_mutex_t mutex;
+    gsheet_cond_t completed;
+    TransportTenant* tenants;
+    TransportTenant* cursor;    // с кого начинать следующий круг
+    size_t queued;
+    size_t in_flight;
+    size_t max_in_flight;       // max_connections * max_streams
+    size_t per_client_streams;
+    int stopping;
+} GSheetTransport;
+
+// Раздаём свободные потоки по кругу, по одному запросу клиенту за проход.
+// Вызывается под transport->mutex
+static void transport_admit(GSheetTransport* transport) {
+    int admitted = 1;
+    while (admitted && transport->queued > 0 && transport->in_flight < transport->max_in_flight) {
+        admitted = 0;
+        TransportTenant* start = transport->cursor ? transport->cursor : transport->tenants;
+        TransportTenant* tenant = start;
+        do {
+            TransportTenant* next = tenant->next ? tenant->next : transport->tenants;
+            if (tenant->head && tenant->in_flight < transport->per_client_streams
+                && transport->in_flight < transport->max_in_flight) {
+                TransportRequest* request = tenant->head;
+                tenant->head = request->next;
+                if (!tenant->head) tenant->tail = NULL;
+                transport->queued--;
+                // Следующий круг начнётся с клиента после обслуженного
+                transport->cursor = next;
+
+                CURLMcode code = curl_multi_add_handle(transport->multi, request->curl);
+                if (code != CURLM_OK) {
+                    fprintf(stderr, "Transport error: %s\n", curl_multi_strerror(code));
+                    request->result = CURLE_FAILED_INIT;
+                    request->done = 1;
+                    gsheet_cond_broadcast(&transport->completed);
+                }
+                else {
+                    tenant->in_flight++;
+                    transport->in_flight++;
+                    admitted = 1;
+                }
+            }
+            tenant = next;
+        } while (tenant != start);
+    }
+}
+
+static void transport_worker(void* arg) {
+    GSheetTransport* transport = arg;
+
+    for (;;) {
+        gsheet_mutex_lock(&transport->mutex);
+        transport_admit(transport);
+        const int stop = transport->stopping && transport->in_flight == 0 && transport->queued == 0;
+        gsheet_mutex_unlock(&transport->mutex);
+        if (stop) break;
+
+        int running = 0;
+        curl_multi_perform(transport->multi, &running);
+
+        CURLMsg* message = NULL;
+        int remaining = 0;
+        while ((message = curl_multi_info_read(transport->multi, &remaining)) != NULL) {
+            if (message->msg != CURLMSG_DONE) continue;
+            TransportRequest* request = NULL;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char**)&request);
+            const CURLcode result = message->data.result;
+            curl_multi_remove_handle(transport->multi, message->easy_handle);
+
+            gsheet_mutex_lock(&transport->mutex);
+            request->result = result;
+            request->done = 1;
+            request->tenant->in_flight--;
+            transport->in_flight--;
+            gsheet_cond_broadcast(&transport->completed);
+            gsheet_mutex_unlock(&transport->mutex);
+        }
+
+        // Просыпаемся по сокетам или по curl_multi_wakeup из gsheet_transport_perform
+        curl_multi_poll(transport->multi, NULL, 0, 1000, NULL);
+    }
+}
+
+// max_connections - соединений к хосту, max_streams - потоков HTTP/2 в соединении,
+// per_client_streams - одновременных запросов одного клиента; 0 - по умолчанию
+GSheetTransport* gsheet_transport_create(size_t max_connections, size_t max_streams, size_t per_client_streams) {
+    if (max_connections == 0) max_connections = 2;
+    if (max_streams == 0) max_streams = 100;
+    if (per_client_streams == 0) per_client_streams = 8;
+
+    GSheetTransport* transport = calloc(1, sizeof(GSheetTransport));
+    if (!transport) return NULL;
+    transport->max_in_flight = max_connections * max_streams;
+    transport->per_client_streams = per_client_streams;
+
+    transport->multi = curl_multi_init();
+    if (!transport->multi) {
+        fprintf(stderr, "Failed to initialize CURL multi\n");
+        free(transport);
+        return NULL;
+    }
+    curl_multi_setopt(transport->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(transport->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_connections);
+    curl_multi_setopt(transport->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_connections);
+    curl_multi_setopt(transport->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)max_streams);
+
+    gsheet_mutex_init(&transport->mutex);
+    gsheet_cond_init(&transport->completed);
+    if (!gsheet_thread_create(&transport->thread, transport_worker, transport)) {
+        fprintf(stderr, "Cannot start transport thread\n");
+        gsheet_cond_destroy(&transport->completed);
+        gsheet_mutex_destroy(&transport->mutex);
+        curl_multi_cleanup(transport->multi);
+        free(transport);
+        return NULL;
+    }
+    return transport;
+}
+
+// Клиенты должны быть отключены (gsheet_attach_transport(client, NULL) или gsheet_free)
+void gsheet_transport_destroy(GSheetTransport* transport) {
+    if (!transport) return;
+    gsheet_mutex_lock(&transport->mutex);
+    transport->stopping = 1;
+    gsheet_mutex_unlock(&transport->mutex);
+    curl_multi_wakeup(transport->multi);
+    gsheet_thread_join(transport->thread);
+
+    while (transport->tenants) {
+        TransportTenant* tenant = transport->tenants;
+        transport->tenants = tenant->next;
+        free(tenant);
+    }
+    gsheet_cond_destroy(&transport->completed);
+    gsheet_mutex_destroy(&transport->mutex);
+    curl_multi_cleanup(transport->multi);
+    free(transport);
+}
+
+// Подключение клиента к транспорту; NULL возвращает клиента к своим соединениям.
+// Переключать можно только между запросами клиента
+void gsheet_attach_transport(GSheetClient* client, GSheetTransport* transport) {
+    if (!client || client->transport == transport) return;
+
+    if (client->transport) {
+        GSheetTransport* previous = client->transport;
+        gsheet_mutex_lock(&previous->mutex);
+        TransportTenant** link = &previous->tenants;
+        while (*link && *link != client->tenant) link = &(*link)->next;
+        if (*link) *link = client->tenant->next;
+        if (previous->cursor == client->tenant) previous->cursor = NULL;
+        gsheet_mutex_unlock(&previous->mutex);
+        free(client->tenant);
+        client->tenant = NULL;
+        client->transport = NULL;
+    }
+
+    if (transport) {
+        TransportTenant* tenant = calloc(1, sizeof(TransportTenant));
+        if (!tenant) {
+            fprintf(stderr, "Cannot attach client to transport\n");
+            return;
+        }
+        gsheet_mutex_lock(&transport->mutex);
+        tenant->next = transport->tenants;
+        transport->tenants = tenant;
+        gsheet_mutex_unlock(&transport->mutex);
+        client->tenant = tenant;
+        client->transport = transport;
+    }
+}
+
+// Выполняет подготовленный easy-хендл через транспорт клиента и ждёт результата.
+// Соединение остаётся в multi, хендл после запроса снова свободен
+static CURLcode gsheet_transport_perform(GSheetClient* client, CURL* curl) {
+    GSheetTransport* transport = client->transport;
+    TransportRequest request;
+    memset(&request, 0, sizeof(request));
+    request.curl = curl;
+    request.tenant = client->tenant;
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (char*)&request);
+
+    gsheet_mutex_lock(&transport->mutex);
+    if (request.tenant->tail) request.tenant->tail->next = &request;
+    else request.tenant->head = &request;
+    request.tenant->tail = &request;
+    transport->queued++;
+    gsheet_mutex_unlock(&transport->mutex);
+    curl_multi_wakeup(transport->multi);
+
+    gsheet_mutex_lock(&transport->mutex);
+    while (!request.done) {
+        gsheet_cond_wait(&transport->completed, &transport->mutex);
+    }
+    gsheet_mutex_unlock(&transport->mutex);
+    return request.result;
+}
+
+// 28. Локальный пересчёт формул
+//
+// Формулы читаются с valueRenderOption=FORMULA, разбираются в деревья
+// выражений и связываются в граф зависимостей (для каждой ячейки - список
+// зависящих от неё формул). Изменение ячейки помечает грязными только её
+// транзитивных потомков; пересчёт обходит грязные формулы в топологическом
+// порядке (Kahn), так что каждая считается один раз, после всех своих входов.
+// Поддерживаются числа, строки, TRUE/FALSE, ссылки и диапазоны (A1, $B$2,
+// A1:C10, A:C, Лист!A1 того же листа), + - * / ^, сравнения, унарный минус,
+// функции SUM, AVERAGE, IF, VLOOKUP.
+
+typedef enum {
+    CALC_NUMBER,
+    CALC_TEXT,
+    CALC_BOOL,
+    CALC_REF,
+    CALC_RANGE,
+    CALC_NEGATE,
+    CALC_BINARY,
+    CALC_CALL,
+    CALC_ERROR
+} CalcExprType;
+
+typedef enum {
+    CALC_FN_SUM,
+    CALC_FN_AVERAGE,
+    CALC_FN_IF,
+    CALC_FN_VLOOKUP,
+    CALC_FN_UNKNOWN
+} CalcFunction;
+
+typedef struct CalcExpr {
+    CalcExprType type;
+    char op;                    // BINARY: + - * / ^ = < > l(<=) g(>=) n(<>)
+    CalcFunction function;
+    double number;
+    char* text;                 // TEXT: строка; ERROR: статический код ошибки
+    size_t row, col;            // REF и начало RANGE, координаты листа с нуля
+    size_t row2, col2;          // конец RANGE включительно
+    struct CalcExpr** args;
+    size_t arg_count;
+} CalcExpr;
+
+typedef struct {
+    GSheetValueType type;
+    unsigned char dirty;
+    double number;
+    char* text;                 // своя копия для TEXT, статический код для ERROR
+    CalcExpr* formula;          // NULL - константа
+    uint32_t* dependents;       // формулы, ссылающиеся на ячейку (с повторами)
+    uint32_t dependent_count;
+    uint32_t dependent_cap;
+    uint32_t pending;           // непосчитанные входы при пересчёте
+} CalcCell;
+
+typedef struct GSheetCalc {
+    char* sheet;                // имя листа или NULL
+    size_t origin_row;          // координаты левого верхнего угла сетки на листе
+    size_t origin_col;
+    size_t rows;
+    size_t cols;
+    CalcCell* cells;
+    uint32_t* dirty;            // грязные формулы в порядке пометки
+    size_t dirty_count;
+    size_t dirty_cap;
+    uint32_t* order;            // очередь пересчёта
+} GSheetCalc;
+
+typedef struct {
+    GSheetValueType type;
+    double number;
+    const char* text;
+} CalcValue;
+
+static const char CALC_ERROR_DIV0[] = "#DIV/0!";
+static const char CALC_ERROR_VALUE[] = "#VALUE!";
+static const char CALC_ERROR_NA[] = "#N/A";
+static const char CALC_ERROR_NAME[] = "#NAME?";
+static const char CALC_ERROR_REF[] = "#REF!";
+static const char CALC_ERROR_NUM[] = "#NUM!";
+static const char CALC_ERROR_PARSE[] = "#ERROR!";
+
+static int calc_upper(int c) {
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static int calc_name_equals(const char* a, size_t a_len, const char* b) {
+    size_t i = 0;
+    for (; i < a_len && b[i]; i++) {
+        if (calc_upper((unsigned char)a[i]) != calc_upper((unsigned char)b[i])) return 0;
+    }
+    return i == a_len && b[i] == '\0';
+}
+
+// Ссылка вида [$]COL[$]ROW, COL или ROW может отсутствовать (A:A);
+// возвращает число разобранных символов или 0
+static size_t calc_parse_a1(const char* text, size_t len, size_t* row, size_t* col, int* has_row, int* has_col) {
+    size_t i = 0, letters = 0, digits = 0;
+    size_t column = 0, line = 0;
+
+    if (i < len && text[i] == '$') i++;
+    while (i < len && ((text[i] >= 'A' && text[i] <= 'Z') || (text[i] >= 'a' && text[i] <= 'z'))) {
+        column = column * 26 + (size_t)(calc_upper((unsigned char)text[i]) - 'A' + 1);
+        letters++;
+        i++;
+    }
+    if (letters > 3) return 0;
+    if (i < len && text[i] == '$') i++;
+    while (i < len && text[i] >= '0' && text[i] <= '9') {
+        line = line * 10 + (size_t)(text[i] - '0');
+        digits++;
+        i++;
+        if (digits > 8) return 0;
+    }
+    if ((letters == 0 && digits == 0) || (digits > 0 && line == 0)) return 0;
+
+    *has_col = letters > 0;
+    *has_row = digits > 0;
+    *col = letters ? column - 1 : 0;
+    *row = digits ? line - 1 : 0;
+    return i;
+}
+
+// Ячейка по адресу A1 в API: индекс в сетке или -1
+static long calc_cell_index(const GSheetCalc* calc, const char* address) {
+    size_t row = 0, col = 0;
+    int has_row = 0, has_col = 0;
+    const size_t len = strlen(address);
+    if (calc_parse_a1(address, len, &row, &col, &has_row, &has_col) != len || !has_row || !has_col) return -1;
+    if (row < calc->origin_row || col < calc->origin_col) return -1;
+    row -= calc->origin_row;
+    col -= calc->origin_col;
+    if (row >= calc->rows || col >= calc->cols) return -1;
+    return (long)(row * calc->cols + col);
+}
+
+// Разбор формул: рекурсивный спуск
+typedef struct {
+    const char* p;
+    const GSheetCalc* calc;
+    int failed;
+} CalcParser;
+
+static CalcExpr* calc_expr_new(CalcParser* parser, CalcExprType type) {
+    CalcExpr* expr = calloc(1, sizeof(CalcExpr));
+    if (!expr) {
+        parser->failed = 1;
+        return NULL;
+    }
+    expr->type = type;
+    return expr;
+}
+
+static void calc_expr_free(CalcExpr* expr) {
+    if (!expr) return;
+    for (size_t i = 0; i < expr->arg_count; i++) calc_expr_free(expr->args[i]);
+    free(expr->args);
+    if (expr->type == CALC_TEXT) free(expr->text);
+    free(expr);
+}
+
+static CalcExpr* calc_expr_error(CalcParser* parser, const char* code) {
+    CalcExpr* expr = calc_expr_new(parser, CALC_ERROR);
+    if (expr) expr->text = (char*)code;
+    return expr;
+}
+
+static int calc_expr_push_arg(CalcParser* parser, CalcExpr* expr, CalcExpr* arg) {
+    CalcExpr** args = realloc(expr->args, sizeof(CalcExpr*) * (expr->arg_count + 1));
+    if (!args || !arg) {
+        if (args) expr->args = args;
+        calc_expr_free(arg);
+        parser->failed = 1;
+        return 0;
+    }
+    expr->args = args;
+    expr->args[expr->arg_count++] = arg;
+    return 1;
+}
+
+static void calc_skip_spaces(CalcParser* parser) {
+    while (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' || *parser->p == '\r') parser->p++;
+}
+
+static CalcExpr* calc_parse_comparison(CalcParser* parser);
+
+static int calc_is_name_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+        || c == '_' || c == '.' || c == '$';
+}
+
+// Ссылка или диапазон после (необязательного) имени листа
+static CalcExpr* calc_parse_reference(CalcParser* parser, const char* token, size_t len) {
+    size_t row = 0, col = 0, row2 = 0, col2 = 0;
+    int has_row = 0, has_col = 0, has_row2 = 0, has_col2 = 0;
+    if (calc_parse_a1(token, len, &row, &col, &has_row, &has_col) != len) {
+        // Именованные диапазоны не поддерживаются
+        return calc_expr_error(parser, CALC_ERROR_NAME);
+    }
+
+    if (*parser->p != ':') {
+        if (!has_row || !has_col) return calc_expr_error(parser, CALC_ERROR_PARSE);
+        CalcExpr* expr = calc_expr_new(parser, CALC_REF);
+        if (expr) {
+            expr->row = row;
+            expr->col = col;
+        }
+        return expr;
+    }
+
+    parser->p++;
+    const char* second = parser->p;
+    while (calc_is_name_char(*parser->p)) parser->p++;
+    const size_t second_len = (size_t)(parser->p - second);
+    if (second_len == 0
+        || calc_parse_a1(second, second_len, &row2, &col2, &has_row2, &has_col2) != second_len
+        || !has_col || !has_col2 || has_row != has_row2) {
+        return calc_expr_error(parser, CALC_ERROR_PARSE);
+    }
+
+    CalcExpr* expr = calc_expr_new(parser, CALC_RANGE);
+    if (!expr) return NULL;
+    // A:C - все строки сетки
+    expr->row = has_row ? (row < row2 ? row : row2) : 0;
+    expr->row2 = has_row ? (row < row2 ? row2 : row) : (size_t)-1;
+    expr->col = col < col2 ? col : col2;
+    expr->col2 = col < col2 ? col2 : col;
+    return expr;
+}
+
+static CalcExpr* calc_parse_call(CalcParser* parser, const char* name, size_t len) {
+    CalcExpr* expr = calc_expr_new(parser, CALC_CALL);
+    if (!expr) return NULL;
+    static const char* const names[] = { "SUM", "AVERAGE", "IF", "VLOOKUP" };
+    expr->function = CALC_FN_UNKNOWN;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (calc_name_equals(name, len, names[i])) expr->function = (CalcFunction)i;
+    }
+
+    parser->p++;
+    calc_skip_spaces(parser);
+    if (*parser->p == ')') {
+        parser->p++;
+        return expr;
+    }
+    for (;;) {
+        if (!calc_expr_push_arg(parser, expr, calc_parse_comparison(parser))) break;
+        calc_skip_spaces(parser);
+        // ';' - разделитель аргументов в европейских локалях
+        if (*parser->p == ',' || *parser->p == ';') {
+            parser->p++;
+            continue;
+        }
+        if (*parser->p == ')') parser->p++;
+        else parser->failed = 1;
+        break;
+    }
+    return expr;
+}
+
+static CalcExpr* calc_parse_primary(CalcParser* parser) {
+    calc_skip_spaces(parser);
+    const char c = *parser->p;
+
+    if ((c >= '0' && c <= '9') || c == '.') {
+        char* end = NULL;
+        CalcExpr* expr = calc_expr_new(parser, CALC_NUMBER);
+        if (expr) expr->number = strtod(parser->p, &end);
+        if (end == parser->p) parser->failed = 1;
+        else parser->p = end;
+        return expr;
+    }
+
+    if (c == '"') {
+        // "" внутри строки - кавычка
+        const char* start = ++parser->p;
+        size_t len = 0;
+        while (*parser->p && !(parser->p[0] == '"' && parser->p[1] != '"')) {
+            parser->p += parser->p[0] == '"' ? 2 : 1;
+            len++;
+        }
+        if (*parser->p != '"') {
+            parser->failed = 1;
+            return NULL;
+        }
+        CalcExpr* expr = calc_expr_new(parser, CALC_TEXT);
+        if (expr) expr->text = malloc(len + 1);
+        if (expr && expr->text) {
+            size_t k = 0;
+            for (const char* s = start; s < parser->p; s++) {
+                expr->text[k++] = *s;
+                if (*s == '"') s++;
+            }
+            expr->text[k] = '\0';
+        }
+        else {
+            parser->failed = 1;
+        }
+        parser->p++;
+        return expr;
+    }
+
+    if (c == '(') {
+        parser->p++;
+        CalcExpr* expr = calc_parse_comparison(parser);
+        calc_skip_spaces(parser);
+        if (*parser->p == ')') parser->p++;
+        else parser->failed = 1;
+        return expr;
+    }
+
+    // Имя листа: Лист1!A1 или 'Мой лист'!A1
+    const char* sheet = NULL;
+    size_t sheet_len = 0;
+    if (c == '\'') {
+        sheet = ++parser->p;
+        while (*parser->p && *parser->p != '\'') parser->p++;
+        sheet_len = (size_t)(parser->p - sheet);
+        if (parser->p[0] != '\'' || parser->p[1] != '!') {
+            parser->failed = 1;
+            return NULL;
+        }
+        parser->p += 2;
+    }
+
+    const char* token = parser->p;
+    while (calc_is_name_char(*parser->p)) parser->p++;
+    size_t len = (size_t)(parser->p - token);
+    if (!sheet && *parser->p == '!') {
+        sheet = token;
+        sheet_len = len;
+        token = ++parser->p;
+        while (calc_is_name_char(*parser->p)) parser->p++;
+        len = (size_t)(parser->p - token);
+    }
+    if (len == 0) {
+        parser->failed = 1;
+        return NULL;
+    }
+
+    if (sheet) {
+        // Ссылки на другие листы не вычисляются локально. Если диапазон задан
+        // без имени листа ("A1:D10"), нельзя проверить, что лист тот же
+        CalcExpr* expr = calc_parse_reference(parser, token, len);
+        if (!parser->calc->sheet || !calc_name_equals(sheet, sheet_len, parser->calc->sheet)) {
+            calc_expr_free(expr);
+            return calc_expr_error(parser, CALC_ERROR_REF);
+        }
+        return expr;
+    }
+
+    const char* after = parser->p;
+    calc_skip_spaces(parser);
+    if (*parser->p == '(') return calc_parse_call(parser, token, len);
+    parser->p = after;
+
+    if (calc_name_equals(token, len, "TRUE") || calc_name_equals(token, len, "FALSE")) {
+        CalcExpr* expr = calc_expr_new(parser, CALC_BOOL);
+        if (expr) expr->number = calc_upper((unsigned char)token[0]) == 'T';
+        return expr;
+    }
+    return calc_parse_reference(parser, token, len);
+}
+
+// Унарный минус связывает сильнее ^: -2^2 = 4, как в Google Sheets
+static CalcExpr* calc_parse_unary(CalcParser* parser) {
+    calc_skip_spaces(parser);
+    if (*parser->p == '+') {
+        parser->p++;
+        return calc_parse_unary(parser);
+    }
+    if (*parser->p == '-') {
+        parser->p++;
+        CalcExpr* expr = calc_expr_new(parser, CALC_NEGATE);
+        if (expr) calc_expr_push_arg(parser, expr, calc_parse_unary(parser));
+        return expr;
+    }
+    return calc_parse_primary(parser);
+}
+
+static CalcExpr* calc_binary(CalcParser* parser, char op, CalcExpr* left, CalcExpr* right) {
+    CalcExpr* expr = calc_expr_new(parser, CALC_BINARY);
+    if (!expr) {
+        calc_expr_free(left);
+        calc_expr_free(right);
+        return NULL;
+    }
+    expr->op = op;
+    calc_expr_push_arg(parser, expr, left);
+    calc_expr_push_arg(parser, expr, right);
+    return expr;
+}
+
+static CalcExpr* calc_parse_power(CalcParser* parser) {
+    CalcExpr* expr = calc_parse_unary(parser);
+    for (;;) {
+        calc_skip_spaces(parser);
+        if (*parser->p != '^' || parser->failed) return expr;
+        parser->p++;
+        expr = calc_binary(parser, '^', expr, calc_parse_unary(parser));
+    }
+}
+
+static CalcExpr* calc_parse_term(CalcParser* parser) {
+    CalcExpr* expr = calc_parse_power(parser);
+    for (;;) {
+        calc_skip_spaces(parser);
+        const char op = *parser->p;
+        if ((op != '*' && op != '/') || parser->failed) return expr;
+        parser->p++;
+        expr = calc_binary(parser, op, expr, calc_parse_power(parser));
+    }
+}
+
+static CalcExpr* calc_parse_additive(CalcParser* parser) {
+    CalcExpr* expr = calc_parse_term(parser);
+    for (;;) {
+        calc_skip_spaces(parser);
+        const char op = *parser->p;
+        if ((op != '+' && op != '-') || parser->failed) return expr;
+        parser->p++;
+        expr = calc_binary(parser, op, expr, calc_parse_term(parser));
+    }
+}
+
+static CalcExpr* calc_parse_comparison(CalcParser* parser) {
+    CalcExpr* expr = calc_parse_additive(parser);
+    for (;;) {
+        calc_skip_spaces(parser);
+        char op = *parser->p;
+        if ((op != '=' && op != '<' && op != '>') || parser->failed) return expr;
+        parser->p++;
+        if (op == '<' && *parser->p == '=') { op = 'l'; parser->p++; }
+        else if (op == '>' && *parser->p == '=') { op = 'g'; parser->p++; }
+        else if (op == '<' && *parser->p == '>') { op = 'n'; parser->p++; }
+        expr = calc_binary(parser, op, expr, calc_parse_additive(parser));
+    }
+}
+
+// Формула без ведущего '='; при синтаксической ошибке - выражение #ERROR!
+static CalcExpr* calc_parse_formula(const GSheetCalc* calc, const char* text) {
+    CalcParser parser = { text, calc, 0 };
+    CalcExpr* expr = calc_parse_comparison(&parser);
+    calc_skip_spaces(&parser);
+    if (parser.failed || *parser.p != '\0' || !expr) {
+        calc_expr_free(expr);
+        parser.failed = 0;
+        expr = calc_expr_error(&parser, CALC_ERROR_PARSE);
+    }
+    return expr;
+}
+
+// Граф зависимостей: рёбра от ячеек, на которые ссылается формула, к ней самой
+static int calc_add_dependent(CalcCell* cell, uint32_t dependent) {
+    if (cell->dependent_count == cell->dependent_cap) {
+        uint32_t cap = cell->dependent_cap ? cell->dependent_cap * 2 : 4;
+        uint32_t* grown = realloc(cell->dependents, sizeof(uint32_t) * cap);
+        if (!grown) return 0;
+        cell->dependents = grown;
+        cell->dependent_cap = cap;
+    }
+    cell->dependents[cell->dependent_count++] = dependent;
+    return 1;
+}
+
+static void calc_remove_dependent(CalcCell* cell, uint32_t dependent) {
+    for (uint32_t i = 0; i < cell->dependent_count; i++) {
+        if (cell->dependents[i] == dependent) {
+            cell->dependents[i] = cell->dependents[--cell->dependent_count];
+            return;
+        }
+    }
+}
+
+// Пересечение ссылки или диапазона с сеткой в индексах сетки [first, last];
+// 0, если пересечения нет
+static int calc_clip(const GSheetCalc* calc, const CalcExpr* expr,
+                     size_t* first_row, size_t* last_row, size_t* first_col, size_t* last_col) {
+    const size_t row2 = expr->type == CALC_REF ? expr->row : expr->row2;
+    const size_t col2 = expr->type == CALC_REF ? expr->col : expr->col2;
+    if (calc->rows == 0 || calc->cols == 0) return 0;
+    if (row2 < calc->origin_row || col2 < calc->origin_col) return 0;
+    *first_row = expr->row > calc->origin_row ? expr->row - calc->origin_row : 0;
+    *first_col = expr->col > calc->origin_col ? expr->col - calc->origin_col : 0;
+    *last_row = row2 - calc->origin_row < calc->rows - 1 ? row2 - calc->origin_row : calc->rows - 1;
+    *last_col = col2 - calc->origin_col < calc->cols - 1 ? col2 - calc->origin_col : calc->cols - 1;
+    return *first_row <= *last_row && *first_col <= *last_col;
+}
+
+// Обходит ячейки сетки, на которые ссылается выражение; link - добавить или убрать рёбра
+static void calc_link(GSheetCalc* calc, const CalcExpr* expr, uint32_t formula, int link) {
+    if (expr->type == CALC_REF || expr->type == CALC_RANGE) {
+        size_t first_row, last_row, first_col, last_col;
+        if (!calc_clip(calc, expr, &first_row, &last_row, &first_col, &last_col)) return;
+        for (size_t r = first_row; r <= last_row; r++) {
+            for (size_t c = first_col; c <= last_col; c++) {
+                CalcCell* cell = &calc->cells[r * calc->cols + c];
+                if (link) calc_add_dependent(cell, formula);
+                else calc_remove_dependent(cell, formula);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < expr->arg_count; i++) calc_link(calc, expr->args[i], formula, link);
+}
+
+static void calc_mark_dirty(GSheetCalc* calc, uint32_t index) {
+    CalcCell* cell = &calc->cells[index];
+    if (cell->dirty || !cell->formula) return;
+    if (calc->dirty_count == calc->dirty_cap) {
+        size_t cap = calc->dirty_cap ? calc->dirty_cap * 2 : 64;
+        uint32_t* dirty = realloc(calc->dirty, sizeof(uint32_t) * cap);
+        uint32_t* order = realloc(calc->order, sizeof(uint32_t) * cap);
+        if (dirty) calc->dirty = dirty;
+        if (order) calc->order = order;
+        if (!dirty || !order) return;
+        calc->dirty_cap = cap;
+    }
+    cell->dirty = 1;
+    calc->dirty[calc->dirty_count++] = index;
+}
+
+// Грязными становятся все формулы, транзитивно зависящие от ячейки
+static void calc_invalidate(GSheetCalc* calc, uint32_t index) {
+    const size_t first = calc->dirty_count;
+    const CalcCell* changed = &calc->cells[index];
+    for (uint32_t i = 0; i < changed->dependent_count; i++) calc_mark_dirty(calc, changed->dependents[i]);
+    // Список грязных служит и стеком обхода: новые добавляются в конец
+    for (size_t k = first; k < calc->dirty_count; k++) {
+        const CalcCell* cell = &calc->cells[calc->dirty[k]];
+        for (uint32_t i = 0; i < cell->dependent_count; i++) calc_mark_dirty(calc, cell->dependents[i]);
+    }
+}
+
+// Константа из текста ячейки: число, TRUE/FALSE, строка или пусто
+static void calc_cell_set_constant(CalcCell* cell, const char* text) {
+    char* end = NULL;
+    if (cell->type == GSHEET_VALUE_TEXT) free(cell->text);
+    cell->text = NULL;
+    cell->number = 0;
+
+    if (!text || !*text) {
+        cell->type = GSHEET_VALUE_EMPTY;
+        return;
+    }
+    const double number = strtod(text, &end);
+    if (end != text && *end == '\0') {
+        cell->type = GSHEET_VALUE_NUMBER;
+        cell->number = number;
+    }
+    else if (calc_name_equals(text, strlen(text), "TRUE") || calc_name_equals(text, strlen(text), "FALSE")) {
+        cell->type = GSHEET_VALUE_BOOL;
+        cell->number = calc_upper((unsigned char)text[0]) == 'T';
+    }
+    else {
+        cell->text = strdup(text);
+        cell->type = cell->text ? GSHEET_VALUE_TEXT : GSHEET_VALUE_EMPTY;
+    }
+}
+
+// Новое содержимое ячейки: формула ("=...") или константа
+static void calc_cell_assign(GSheetCalc* calc, uint32_t index, const char* input) {
+    CalcCell* cell = &calc->cells[index];
+    if (cell->formula) {
+        calc_link(calc, cell->formula, index, 0);
+        calc_expr_free(cell->formula);
+        cell->formula = NULL;
+    }
+
+    if (input && input[0] == '=') {
+        cell->formula = calc_parse_formula(calc, input + 1);
+        if (cell->formula) calc_link(calc, cell->formula, index, 1);
+        calc_mark_dirty(calc, index);
+    }
+    else {
+        calc_cell_set_constant(cell, input);
+    }
+}
+
+// Вычисление
+static CalcValue calc_error(const char* code) {
+    CalcValue value = { GSHEET_VALUE_ERROR, 0, code };
+    return value;
+}
+
+static CalcValue calc_number(double number) {
+    CalcValue value = { GSHEET_VALUE_NUMBER, number, NULL };
+    if (isnan(number) || isinf(number)) return calc_error(CALC_ERROR_NUM);
+    return value;
+}
+
+static CalcValue calc_bool(int flag) {
+    CalcValue value = { GSHEET_VALUE_BOOL, flag ? 1 : 0, NULL };
+    return value;
+}
+
+// Ячейка по координатам листа; вне сетки - пусто
+static CalcValue calc_cell_value(const GSheetCalc* calc, size_t row, size_t col) {
+    CalcValue value = { GSHEET_VALUE_EMPTY, 0, NULL };
+    if (row < calc->origin_row || col < calc->origin_col) return value;
+    row -= calc->origin_row;
+    col -= calc->origin_col;
+    if (row >= calc->rows || col >= calc->cols) return value;
+    const CalcCell* cell = &calc->cells[row * calc->cols + col];
+    value.type = cell->type;
+    value.number = cell->number;
+    value.text = cell->text;
+    return value;
+}
+
+// Число для арифметики; текст, не являющийся числом, - #VALUE!
+static CalcValue calc_to_number(CalcValue value) {
+    char* end = NULL;
+    switch (value.type) {
+    case GSHEET_VALUE_EMPTY:
+        return calc_number(0);
+    case GSHEET_VALUE_NUMBER:
+    case GSHEET_VALUE_BOOL:
+        return calc_number(value.number);
+    case GSHEET_VALUE_TEXT: {
+        const double number = strtod(value.text, &end);
+        if (end != value.text && *end == '\0') return calc_number(number);
+        return calc_error(CALC_ERROR_VALUE);
+    }
+    default:
+        return value;
+    }
+}
+
+static int calc_compare_text(const char* a, const char* b) {
+    for (; *a && calc_upper((unsigned char)*a) == calc_upper((unsigned char)*b); a++, b++) {}
+    const int diff = calc_upper((unsigned char)*a) - calc_upper((unsigned char)*b);
+    return (diff > 0) - (diff < 0);
+}
+
+// Порядок Google Sheets: числа < строки < логические; пустая ячейка
+// сравнивается как 0, "" или FALSE в зависимости от второго операнда
+static int calc_compare(CalcValue a, CalcValue b) {
+    static const int rank[] = { 0, 0, 1, 2, 3 };
+    if (a.type == GSHEET_VALUE_EMPTY) {
+        a.type = b.type == GSHEET_VALUE_EMPTY ? GSHEET_VALUE_NUMBER : b.type;
+        a.text = "";
+    }
+    if (b.type == GSHEET_VALUE_EMPTY) {
+        b.type = a.type;
+        b.text = "";
+    }
+    if (rank[a.type] != rank[b.type]) return rank[a.type] < rank[b.type] ? -1 : 1;
+    if (a.type == GSHEET_VALUE_TEXT) return calc_compare_text(a.text, b.text);
+    return (a.number > b.number) - (a.number < b.number);
+}
+
+static CalcValue calc_eval(const GSheetCalc* calc, const CalcExpr* expr);
+
+// SUM и AVERAGE: в диапазонах и ссылках учитываются только числа,
+// остальные аргументы приводятся к числу
+static CalcValue calc_aggregate(const GSheetCalc* calc, const CalcExpr* expr, double* sum, size_t* count) {
+    *sum = 0;
+    *count = 0;
+    for (size_t i = 0; i < expr->arg_count; i++) {
+        const CalcExpr* arg = expr->args[i];
+        if (arg->type == CALC_REF || arg->type == CALC_RANGE) {
+            // Ячейки вне сетки пусты и в сумму не входят
+            size_t first_row, last_row, first_col, last_col;
+            if (!calc_clip(calc, arg, &first_row, &last_row, &first_col, &last_col)) continue;
+            for (size_t r = first_row; r <= last_row; r++) {
+                const CalcCell* line = &calc->cells[r * calc->cols];
+                for (size_t c = first_col; c <= last_col; c++) {
+                    if (line[c].type == GSHEET_VALUE_ERROR) return calc_error(line[c].text);
+                    if (line[c].type == GSHEET_VALUE_NUMBER) {
+                        *sum += line[c].number;
+                        (*count)++;
+                    }
+                }
+            }
+        }
+        else {
+            const CalcValue value = calc_to_number(calc_eval(calc, arg));
+            if (value.type == GSHEET_VALUE_ERROR) return value;
+            *sum += value.number;
+            (*count)++;
+        }
+    }
+    return calc_number(*sum);
+}
+
+// VLOOKUP(ключ, диапазон, номер_столбца, [отсортирован = TRUE])
+static CalcValue calc_vlookup(const GSheetCalc* calc, const CalcExpr* expr) {
+    if (expr->arg_count < 3 || expr->arg_count > 4 || expr->args[1]->type != CALC_RANGE) {
+        return calc_error(CALC_ERROR_NA);
+    }
+    const CalcValue key = calc_eval(calc, expr->args[0]);
+    if (key.type == GSHEET_VALUE_ERROR) return key;
+    const CalcValue index = calc_to_number(calc_eval(calc, expr->args[2]));
+    if (index.type == GSHEET_VALUE_ERROR) return index;
+    int sorted = 1;
+    if (expr->arg_count == 4) {
+        const CalcValue flag = calc_to_number(calc_eval(calc, expr->args[3]));
+        if (flag.type == GSHEET_VALUE_ERROR) return flag;
+        sorted = flag.number != 0;
+    }
+
+    const CalcExpr* range = expr->args[1];
+    const size_t width = range->col2 - range->col + 1;
+    if (index.number < 1) return calc_error(CALC_ERROR_VALUE);
+    if (index.number >= (double)width + 1) return calc_error(CALC_ERROR_REF);
+    const size_t column = range->col + (size_t)index.number - 1;
+
+    // Строки диапазона, попадающие в сетку (координаты листа)
+    size_t first_row, last_row, first_col, last_col;
+    if (!calc_clip(calc, range, &first_row, &last_row, &first_col, &last_col)) return calc_error(CALC_ERROR_NA);
+    const size_t first = first_row + calc->origin_row;
+    const size_t last = last_row + calc->origin_row;
+
+    if (!sorted) {
+        for (size_t r = first; r <= last; r++) {
+            const CalcValue candidate = calc_cell_value(calc, r, range->col);
+            if (candidate.type != GSHEET_VALUE_EMPTY && calc_compare(candidate, key) == 0) {
+                return calc_cell_value(calc, r, column);
+            }
+        }
+        return calc_error(CALC_ERROR_NA);
+    }
+
+    // Отсортированный столбец: последняя строка с ключом <= искомого, бинарным поиском
+    size_t low = first, high = last + 1, found = (size_t)-1;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (calc_compare(calc_cell_value(calc, middle, range->col), key) <= 0) {
+            found = middle;
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return found == (size_t)-1 ? calc_error(CALC_ERROR_NA) : calc_cell_value(calc, found, column);
+}
+
+static CalcValue calc_call(const GSheetCalc* calc, const CalcExpr* expr) {
+    double sum = 0;
+    size_t count = 0;
+    switch (expr->function) {
+    case CALC_FN_SUM:
+        return calc_aggregate(calc, expr, &sum, &count);
+    case CALC_FN_AVERAGE: {
+        const CalcValue total = calc_aggregate(calc, expr, &sum, &count);
+        if (total.type == GSHEET_VALUE_ERROR) return total;
+        return count ? calc_number(sum / (double)count) : calc_error(CALC_ERROR_DIV0);
+    }
+    case CALC_FN_IF: {
+        if (expr->arg_count < 2 || expr->arg_count > 3) return calc_error(CALC_ERROR_NA);
+        const CalcValue condition = calc_eval(calc, expr->args[0]);
+        if (condition.type == GSHEET_VALUE_ERROR) return condition;
+        if (condition.type == GSHEET_VALUE_TEXT) return calc_error(CALC_ERROR_VALUE);
+        if (condition.number != 0) return calc_eval(calc, expr->args[1]);
+        return expr->arg_count == 3 ? calc_eval(calc, expr->args[2]) : calc_bool(0);
+    }
+    case CALC_FN_VLOOKUP:
+        return calc_vlookup(calc, expr);
+    default:
+        return calc_error(CALC_ERROR_NAME);
+    }
+}
+
+static CalcValue calc_eval(const GSheetCalc* calc, const CalcExpr* expr) {
+    CalcValue value = { GSHEET_VALUE_EMPTY, 0, NULL };
+    switch (expr->type) {
+    case CALC_NUMBER:
+        return calc_number(expr->number);
+    case CALC_TEXT:
+        value.type = GSHEET_VALUE_TEXT;
+        value.text = expr->text;
+        return value;
+    case CALC_BOOL:
+        return calc_bool(expr->number != 0);
+    case CALC_REF:
+        return calc_cell_value(calc, expr->row, expr->col);
+    case CALC_RANGE:
+        // Диапазон вне функции: неявное пересечение не поддерживается
+        return calc_error(CALC_ERROR_VALUE);
+    case CALC_NEGATE: {
+        const CalcValue operand = calc_to_number(calc_eval(calc, expr->args[0]));
+        return operand.type == GSHEET_VALUE_ERROR ? operand : calc_number(-operand.number);
+    }
+    case CALC_CALL:
+        return calc_call(calc, expr);
+    case CALC_BINARY:
+        break;
+    default:
+        return calc_error(expr->text ? expr->text : CALC_ERROR_PARSE);
+    }
+
+    const CalcValue left = calc_eval(calc, expr->args[0]);
+    if (left.type == GSHEET_VALUE_ERROR) return left;
+    const CalcValue right = calc_eval(calc, expr->args[1]);
+    if (right.type == GSHEET_VALUE_ERROR) return right;
+
+    switch (expr->op) {
+    case '=': return calc_bool(calc_compare(left, right) == 0);
+    case 'n': return calc_bool(calc_compare(left, right) != 0);
+    case '<': return calc_bool(calc_compare(left, right) < 0);
+    case '>': return calc_bool(calc_compare(left, right) > 0);
+    case 'l': return calc_bool(calc_compare(left, right) <= 0);
+    case 'g': return calc_bool(calc_compare(left, right) >= 0);
+    default: break;
+    }
+
+    const CalcValue a = calc_to_number(left);
+    if (a.type == GSHEET_VALUE_ERROR) return a;
+    const CalcValue b = calc_to_number(right);
+    if (b.type == GSHEET_VALUE_ERROR) return b;
+    switch (expr->op) {
+    case '+': return calc_number(a.number + b.number);
+    case '-': return calc_number(a.number - b.number);
+    case '*': return calc_number(a.number * b.number);
+    case '/': return b.number == 0 ? calc_error(CALC_ERROR_DIV0) : calc_number(a.number / b.number);
+    default: return calc_number(pow(a.number, b.number));
+    }
+}
+
+static void calc_store(CalcCell* cell, CalcValue value) {
+    char* text = NULL;
+    if (value.type == GSHEET_VALUE_TEXT) {
+        text = strdup(value.text);
+        if (!text) value = calc_error(CALC_ERROR_VALUE);
+    }
+    if (cell->type == GSHEET_VALUE_TEXT) free(cell->text);
+    cell->type = value.type;
+    cell->number = value.number;
+    cell->text = value.type == GSHEET_VALUE_TEXT ? text : (char*)value.text;
+}
+
+// Пересчёт грязных формул в топологическом порядке; возвращает число пересчитанных
+size_t gsheet_calc_recalc(GSheetCalc* calc) {
+    if (!calc || calc->dirty_count == 0) return 0;
+    size_t head = 0, tail = 0, computed = 0;
+
+    // pending - число рёбер от грязных ячеек; все зависимые грязной тоже грязные
+    for (size_t k = 0; k < calc->dirty_count; k++) calc->cells[calc->dirty[k]].pending = 0;
+    for (size_t k = 0; k < calc->dirty_count; k++) {
+        const CalcCell* cell = &calc->cells[calc->dirty[k]];
+        for (uint32_t i = 0; i < cell->dependent_count; i++) calc->cells[cell->dependents[i]].pending++;
+    }
+    for (size_t k = 0; k < calc->dirty_count; k++) {
+        if (calc->cells[calc->dirty[k]].pending == 0) calc->order[tail++] = calc->dirty[k];
+    }
+
+    while (head < tail) {
+        const uint32_t index = calc->order[head++];
+        CalcCell* cell = &calc->cells[index];
+        // Формулу могли заменить константой после пометки
+        if (cell->formula) calc_store(cell, calc_eval(calc, cell->formula));
+        cell->dirty = 0;
+        computed++;
+        for (uint32_t i = 0; i < cell->dependent_count; i++) {
+            CalcCell* dependent = &calc->cells[cell->dependents[i]];
+            if (--dependent->pending == 0) calc->order[tail++] = cell->dependents[i];
+        }
+    }
+
+    // Оставшиеся грязными ячейки лежат на циклах или зависят от них
+    for (size_t k = 0; k < calc->dirty_count; k++) {
+        CalcCell* cell = &calc->cells[calc->dirty[k]];
+        if (!cell->dirty) continue;
+        if (cell->formula) calc_store(cell, calc_error(CALC_ERROR_REF));
+        cell->dirty = 0;
+    }
+    calc->dirty_count = 0;
+    return computed;
+}
+
+void gsheet_calc_free(GSheetCalc* calc) {
+    if (!calc) return;
+    for (size_t i = 0; i < calc->rows * calc->cols; i++) {
+        CalcCell* cell = &calc->cells[i];
+        calc_expr_free(cell->formula);
+        if (cell->type == GSHEET_VALUE_TEXT) free(cell->text);
+        free(cell->dependents);
+    }
+    free(calc->cells);
+    free(calc->dirty);
+    free(calc->order);
+    free(calc->sheet);
+    free(calc);
+}
+
+// Модель из диапазона формул (как вернул gsheet_read_formulas). range - адрес,
+// с которого прочитаны данные ("Лист1!B2:F50"): по нему определяются лист и
+// положение сетки, чтобы ссылки в формулах указывали на нужные ячейки
+GSheetCalc* gsheet_calc_create(const SheetRange* formulas, const char* range) {
+    if (!formulas || !range) return NULL;
+    if (formulas->rows * formulas->cols >= (size_t)UINT32_MAX) {
+        fprintf(stderr, "Range is too large for local calculation\n");
+        return NULL;
+    }
+
+    const size_t count = formulas->rows * formulas->cols;
+    GSheetCalc* calc = calloc(1, sizeof(GSheetCalc));
+    if (!calc) return NULL;
+    calc->rows = formulas->rows;
+    calc->cols = formulas->cols;
+    calc->cells = calloc(count ? count : 1, sizeof(CalcCell));
+    if (!calc->cells) {
+        free(calc);
+        return NULL;
+    }
+
+    // "Лист!A1:B2", "'Мой лист'!A1:B2", "Лист", "A1:B2"
+    const char* cells = range;
+    const char* bang = strrchr(range, '!');
+    if (bang) {
+        const char* name = range;
+        size_t len = (size_t)(bang - range);
+        if (len >= 2 && name[0] == '\'' && name[len - 1] == '\'') {
+            name++;
+            len -= 2;
+        }
+        calc->sheet = strndup(name, len);
+        cells = bang + 1;
+    }
+    size_t row = 0, col = 0;
+    int has_row = 0, has_col = 0;
+    const size_t len = strcspn(cells, ":");
+    // Без '!' одиночное "ABC" - имя листа, а не столбец
+    const int is_cells = calc_parse_a1(cells, len, &row, &col, &has_row, &has_col) == len
+        && (bang || has_row || cells[len] == ':');
+    if (is_cells) {
+        calc->origin_row = has_row ? row : 0;
+        calc->origin_col = has_col ? col : 0;
+    }
+    else if (!bang) {
+        calc->sheet = strdup(range);
+    }
+
+    for (size_t r = 0; r < calc->rows; r++) {
+        for (size_t c = 0; c < calc->cols; c++) {
+            calc_cell_assign(calc, (uint32_t)(r * calc->cols + c), formulas->data[r][c]);
+        }
+    }
+    gsheet_calc_recalc(calc);
+    return calc;
+}
+
+// Формулы вместо значений: "=SUM(A1:A3)" вместо "6"
+SheetRange* gsheet_read_formulas(GSheetClient* client, const char* range) {
+    return gsheet_read_values(client, range, "?valueRenderOption=FORMULA");
+}
+
+GSheetCalc* gsheet_calc_load(GSheetClient* client, const char* range) {
+    SheetRange* formulas = gsheet_read_formulas(client, range);
+    if (!formulas) return NULL;
+    GSheetCalc* calc = gsheet_calc_create(formulas, range);
+    gsheet_free_range(formulas);
+    return calc;
+}
+
+// Изменение ячейки ("B3") на константу или формулу ("=A1*2"). Пересчёт
+// откладывается до gsheet_calc_recalc или чтения значения
+bool gsheet_calc_set(GSheetCalc* calc, const char* cell, const char* input) {
+    const long index = calc ? calc_cell_index(calc, cell) : -1;
+    if (index < 0) {
+        fprintf(stderr, "Cell %s is outside of calculation range\n", cell ? cell : "(null)");
+        return false;
+    }
+    calc_cell_assign(calc, (uint32_t)index, input);
+    calc_invalidate(calc, (uint32_t)index);
+    return true;
+}
+
+// Быстрый путь для сценариев: числовое значение без разбора строки
+bool gsheet_calc_set_number(GSheetCalc* calc, const char* cell, double value) {
+    const long index = calc ? calc_cell_index(calc, cell) : -1;
+    if (index < 0) {
+        fprintf(stderr, "Cell %s is outside of calculation range\n", cell ? cell : "(null)");
+        return false;
+    }
+    calc_cell_assign(calc, (uint32_t)index, NULL);
+    CalcCell* target = &calc->cells[index];
+    target->type = GSHEET_VALUE_NUMBER;
+    target->number = value;
+    calc_invalidate(calc, (uint32_t)index);
+    return true;
+}
+
+bool gsheet_calc_get(GSheetCalc* calc, const char* cell, GSheetValue* out) {
+    const long index = calc ? calc_cell_index(calc, cell) : -1;
+    if (index < 0 || !out) return false;
+    gsheet_calc_recalc(calc);
+    const CalcCell* target = &calc->cells[index];
+    out->type = target->type;
+    out->number = target->number;
+    out->text = target->text;
+    return true;
+}
+
+// 29. Локальные запросы: сортировка, фильтр, проекция, top-k
+//
+// Представление (view) не копирует данные: это перестановка индексов строк
+// исходного SheetRange и список его столбцов. Сортировка, фильтр и top-k
+// переставляют и отбрасывают индексы, проекция - столбцы. Номера столбцов
+// во всех функциях - столбцы представления (после проекции).
+// Исходный SheetRange должен жить дольше представления.
+
+typedef struct GSheetView {
+    const SheetRange* source;
+    uint32_t* rows;         // индексы строк source в порядке представления
+    size_t row_count;
+    size_t* columns;        // столбцы source в порядке представления
+    size_t column_count;
+} GSheetView;
+
+GSheetView* gsheet_view_create(const SheetRange* source) {
+    if (!source || source->rows >= (size_t)UINT32_MAX) return NULL;
+    GSheetView* view = calloc(1, sizeof(GSheetView));
+    if (!view) return NULL;
+    view->source = source;
+    view->rows = malloc(sizeof(uint32_t) * (source->rows ? source->rows : 1));
+    view->columns = malloc(sizeof(size_t) * (source->cols ? source->cols : 1));
+    if (!view->rows || !view->columns) {
+        free(view->rows);
+        free(view->columns);
+        free(view);
+        return NULL;
+    }
+    for (size_t i = 0; i < source->rows; i++) view->rows[i] = (uint32_t)i;
+    for (size_t j = 0; j < source->cols; j++) view->columns[j] = j;
+    view->row_count = source->rows;
+    view->column_count = source->cols;
+    return view;
+}
+
+void gsheet_view_free(GSheetView* view) {
+    if (!view) return;
+    free(view->rows);
+    free(view->columns);
+    free(view);
+}
+
+size_t gsheet_view_rows(const GSheetView* view) {
+    return view ? view->row_count : 0;
+}
+
+size_t gsheet_view_cols(const GSheetView* view) {
+    return view ? view->column_count : 0;
+}
+
+// Ячейка представления; вне диапазона или пустая - ""
+const char* gsheet_view_cell(const GSheetView* view, size_t row, size_t col) {
+    if (!view || row >= view->row_count || col >= view->column_count) return "";
+    const char* text = view->source->data[view->rows[row]][view->columns[col]];
+    return text ? text : "";
+}
+
+// Число целиком (как в ячейке, без форматирования) или 0
+static int query_parse_number(const char* text, double* out) {
+    char* end = NULL;
+    if (!text || !*text) return 0;
+    *out = strtod(text, &end);
+    return end != text && *end == '\0';
+}
+
+// Ключ сортировки, разобранный заранее для строк представления,
+// чтобы компаратор не вызывал strtod
+typedef struct {
+    size_t column;              // столбец source
+    GSheetSortType type;
+    int direction;              // 1 или -1
+    unsigned char* kind;        // по строке source: 0 число, 1 текст, 2 пусто
+    double* number;
+} QueryKey;
+
+typedef struct {
+    const SheetRange* source;
+    QueryKey* keys;
+    size_t key_count;
+} QueryOrder;
+
+static void query_order_free(QueryOrder* order) {
+    for (size_t k = 0; k < order->key_count; k++) {
+        free(order->keys[k].kind);
+        free(order->keys[k].number);
+    }
+    free(order->keys);
+}
+
+static int query_order_init(QueryOrder* order, const GSheetView* view,
+                            const GSheetSortKey* keys, size_t key_count) {
+    const size_t source_rows = view->source->rows ? view->source->rows : 1;
+    memset(order, 0, sizeof(QueryOrder));
+    order->source = view->source;
+    order->keys = calloc(key_count ? key_count : 1, sizeof(QueryKey));
+    if (!order->keys) return 0;
+    order->key_count = key_count;
+
+    for (size_t k = 0; k < key_count; k++) {
+        QueryKey* key = &order->keys[k];
+        if (keys[k].column >= view->column_count) {
+            fprintf(stderr, "Sort column %zu is out of range\n", keys[k].column);
+            return 0;
+        }
+        key->column = view->columns[keys[k].column];
+        key->type = keys[k].type;
+        key->direction = keys[k].descending ? -1 : 1;
+        key->kind = malloc(source_rows);
+        key->number = malloc(sizeof(double) * source_rows);
+        if (!key->kind || !key->number) return 0;
+
+        for (size_t i = 0; i < view->row_count; i++) {
+            const uint32_t row = view->rows[i];
+            const char* text = view->source->data[row][key->column];
+            double number = 0;
+            if (!text || !*text) key->kind[row] = 2;
+            else if (key->type != GSHEET_SORT_TEXT && query_parse_number(text, &number)) key->kind[row] = 0;
+            else key->kind[row] = key->type == GSHEET_SORT_NUMBER ? 2 : 1;
+            key->number[row] = number;
+        }
+    }
+    return 1;
+}
+
+// Пустые значения всегда в конце, независимо от направления
+static int query_compare(const QueryOrder* order, uint32_t a, uint32_t b) {
+    for (size_t k = 0; k < order->key_count; k++) {
+        const QueryKey* key = &order->keys[k];
+        const int kind_a = key->kind[a], kind_b = key->kind[b];
+        int result = 0;
+        if (kind_a == 2 || kind_b == 2) {
+            if (kind_a != kind_b) return kind_a == 2 ? 1 : -1;
+            continue;
+        }
+        if (kind_a != kind_b) {
+            result = kind_a < kind_b ? -1 : 1;
+        }
+        else if (kind_a == 0) {
+            result = (key->number[a] > key->number[b]) - (key->number[a] < key->number[b]);
+        }
+        else {
+            const char* text_a = order->source->data[a][key->column];
+            const char* text_b = order->source->data[b][key->column];
+            if (key->type == GSHEET_SORT_TEXT) {
+                const int diff = strcmp(text_a, text_b);
+                result = (diff > 0) - (diff < 0);
+            }
+            else {
+                result = calc_compare_text(text_a, text_b);
+            }
+        }
+        if (result) return result * key->direction;
+    }
+    return 0;
+}
+
+// Устойчивая сортировка слиянием (снизу вверх) индексов rows[0..count)
+static int query_merge_sort(const QueryOrder* order, uint32_t* rows, size_t count) {
+    uint32_t* buffer = malloc(sizeof(uint32_t) * (count ? count : 1));
+    if (!buffer) return 0;
+    uint32_t* from = rows;
+    uint32_t* to = buffer;
+
+    for (size_t width = 1; width < count; width *= 2) {
+        for (size_t left = 0; left < count; left += 2 * width) {
+            const size_t middle = left + width < count ? left + width : count;
+            const size_t right = left + 2 * width < count ? left + 2 * width : count;
+            size_t i = left, j = middle, k = left;
+            while (i < middle && j < right) {
+                // <= 0 берёт левый при равенстве: порядок равных сохраняется
+                to[k++] = query_compare(order, from[i], from[j]) <= 0 ? from[i++] : from[j++];
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < right) to[k++] = from[j++];
+        }
+        uint32_t* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != rows) memcpy(rows, from, sizeof(uint32_t) * count);
+    free(buffer);
+    return 1;
+}
+
+static bool view_sort_from(GSheetView* view, size_t first, const GSheetSortKey* keys, size_t key_count) {
+    QueryOrder order;
+    if (first >= view->row_count) return true;
+    int ok = query_order_init(&order, view, keys, key_count)
+        && query_merge_sort(&order, view->rows + first, view->row_count - first);
+    query_order_free(&order);
+    return ok ? true : false;
+}
+
+// Устойчивая сортировка по нескольким ключам: равные по всем ключам строки
+// сохраняют текущий порядок
+bool gsheet_view_sort(GSheetView* view, const GSheetSortKey* keys, size_t key_count) {
+    if (!view || (!keys && key_count)) return false;
+    return view_sort_from(view, 0, keys, key_count);
+}
+
+// Оставляет строки, для которых predicate вернул true; порядок сохраняется.
+// Возвращает число оставшихся строк
+size_t gsheet_view_filter(GSheetView* view, GSheetRowPredicate predicate, void* userdata) {
+    if (!view || !predicate) return 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < view->row_count; i++) {
+        const uint32_t row = view->rows[i];
+        if (predicate(view->source->data[row], view->source->cols, userdata)) view->rows[kept++] = row;
+    }
+    view->row_count = kept;
+    return kept;
+}
+
+// Фильтр по значению столбца: числа сравниваются как числа, остальное -
+// как текст без учёта регистра; CONTAINS ищет подстроку с учётом регистра
+size_t gsheet_view_filter_column(GSheetView* view, size_t column, GSheetFilterOp op, const char* value) {
+    if (!view || column >= view->column_count) return 0;
+    const size_t source_column = view->columns[column];
+    if (!value) value = "";
+    double value_number = 0;
+    const int value_is_number = query_parse_number(value, &value_number);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < view->row_count; i++) {
+        const uint32_t row = view->rows[i];
+        const char* text = view->source->data[row][source_column];
+        if (!text) text = "";
+        double number = 0;
+        int order = 0, keep = 0;
+
+        if (value_is_number && query_parse_number(text, &number)) {
+            order = (number > value_number) - (number < value_number);
+        }
+        else {
+            order = calc_compare_text(text, value);
+        }
+        switch (op) {
+        case GSHEET_FILTER_EQ: keep = order == 0; break;
+        case GSHEET_FILTER_NE: keep = order != 0; break;
+        case GSHEET_FILTER_LT: keep = order < 0; break;
+        case GSHEET_FILTER_LE: keep = order <= 0; break;
+        case GSHEET_FILTER_GT: keep = order > 0; break;
+        case GSHEET_FILTER_GE: keep = order >= 0; break;
+        case GSHEET_FILTER_CONTAINS: keep = strstr(text, value) != NULL; break;
+        case GSHEET_FILTER_NOT_EMPTY: keep = *text != '\0'; break;
+        default: break;
+        }
+        if (keep) view->rows[kept++] = row;
+    }
+    view->row_count = kept;
+    return kept;
+}
+
+// Проекция: columns - столбцы текущего представления в нужном порядке (можно повторять)
+bool gsheet_view_select(GSheetView* view, const size_t* columns, size_t count) {
+    if (!view || (!columns && count)) return false;
+    size_t* selected = malloc(sizeof(size_t) * (count ? count : 1));
+    if (!selected) return false;
+    for (size_t j = 0; j < count; j++) {
+        if (columns[j] >= view->column_count) {
+            fprintf(stderr, "Column %zu is out of range\n", columns[j]);
+            free(selected);
+            return false;
+        }
+        selected[j] = view->columns[columns[j]];
+    }
+    free(view->columns);
+    view->columns = selected;
+    view->column_count = count;
+    return true;
+}
+
+// Top-k: позиции в представлении, упорядоченные ключами, при равенстве - позицией,
+// чтобы результат совпадал с первыми k строками устойчивой сортировки
+static int query_before(const QueryOrder* order, const GSheetView* view, uint32_t a, uint32_t b) {
+    const int result = query_compare(order, view->rows[a], view->rows[b]);
+    return result < 0 || (result == 0 && a < b);
+}
+
+static void query_sift_down(const QueryOrder* order, const GSheetView* view, uint32_t* heap, size_t count, size_t i) {
+    for (;;) {
+        size_t largest = i;
+        const size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && query_before(order, view, heap[largest], heap[left])) largest = left;
+        if (right < count && query_before(order, view, heap[largest], heap[right])) largest = right;
+        if (largest == i) return;
+        const uint32_t swap = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = swap;
+        i = largest;
+    }
+}
+
+// Первые k строк по ключам без полной сортировки: max-куча из k лучших,
+// O(n log k). Представление сокращается до k строк в отсортированном порядке
+bool gsheet_view_top_k(GSheetView* view, const GSheetSortKey* keys, size_t key_count, size_t k) {
+    if (!view || (!keys && key_count)) return false;
+    if (k >= view->row_count) return gsheet_view_sort(view, keys, key_count);
+    if (k == 0) {
+        view->row_count = 0;
+        return true;
+    }
+
+    QueryOrder order;
+    uint32_t* heap = malloc(sizeof(uint32_t) * k);
+    if (!heap || !query_order_init(&order, view, keys, key_count)) {
+        if (heap) query_order_free(&order);
+        free(heap);
+        return false;
+    }
+
+    // Корень кучи - худшая из лучших k позиций
+    for (size_t i = 0; i < k; i++) heap[i] = (uint32_t)i;
+    for (size_t i = k / 2; i-- > 0; ) query_sift_down(&order, view, heap, k, i);
+    for (size_t i = k; i < view->row_count; i++) {
+        if (query_before(&order, view, (uint32_t)i, heap[0])) {
+            heap[0] = (uint32_t)i;
+            query_sift_down(&order, view, heap, k, 0);
+        }
+    }
+
+    // Извлечение из max-кучи даёт позиции от худшей к лучшей
+    for (size_t count = k; count > 1; count--) {
+        const uint32_t swap = heap[0];
+        heap[0] = heap[count - 1];
+        heap[count - 1] = swap;
+        query_sift_down(&order, view, heap, count - 1, 0);
+    }
+    for (size_t i = 0; i < k; i++) heap[i] = view->rows[heap[i]];
+    memcpy(view->rows, heap, sizeof(uint32_t) * k);
+    view->row_count = k;
+
+    query_order_free(&order);
+    free(heap);
+    return true;
+}
+
+// Запись представления в диапазон (с левого верхнего угла range). Ячейки
+// не копируются: временная таблица указывает на строки исходного SheetRange
+bool gsheet_write_view(GSheetClient* client, const char* range, const GSheetView* view) {
+    if (!client || !range || !view) return false;
+    const size_t rows = view->row_count, cols = view->column_count;
+    const size_t row_slots = rows ? rows : 1;
+    const size_t cell_count = rows * cols;
+    char*** table = malloc(sizeof(char**) * row_slots + sizeof(char*) * (cell_count ? cell_count : 1));
+    if (!table) return false;
+
+    char** cells = (char**)(table + row_slots);
+    for (size_t i = 0; i < rows; i++) {
+        table[i] = cells + i * cols;
+        for (size_t j = 0; j < cols; j++) table[i][j] = (char*)gsheet_view_cell(view, i, j);
+    }
+    SheetRange data = { .data = table, .rows = rows, .cols = cols };
+    bool result = gsheet_write_range(client, range, &data);
+    free(table);
+    return result;
+}
+
+// Сортировка на стороне клиента с записью обратно - явная альтернатива
+// серверному gsheet_sort_range, когда нужны несколько ключей или свои
+// компараторы. Диапазон читается с valueRenderOption=FORMULA: литералы
+// приходят значениями (числа и даты числами), формулы - текстом "=...".
+// Диапазон с формулами не сортируется (false): в другой строке формула
+// ссылалась бы не туда, такой диапазон сортирует gsheet_sort_range.
+// Литералы записываются RAW со своими типами JSON, поэтому текст "00123",
+// "1/2" или "TRUE" остаётся текстом. Форматы остаются на месте; между
+// чтением и записью лист могут изменить
+static bool sort_write_back_values(GSheetClient* client, const char* range, cJSON* values,
+                                   const GSheetSortKey* keys, size_t key_count, size_t header_rows) {
+    size_t rows = 0, cols = 0, numbers = 0;
+    cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        size_t width = 0;
+        cJSON* row_cells = cJSON_IsArray(row) ? row : NULL;
+        cJSON* cell = NULL;
+        cJSON_ArrayForEach(cell, row_cells) {
+            if (cJSON_IsString(cell) && cell->valuestring[0] == '=') {
+                fprintf(stderr, "Range %s contains formulas, use gsheet_sort_range\n", range);
+                return false;
+            }
+            if (cJSON_IsNumber(cell) || cJSON_IsBool(cell)) numbers++;
+            width++;
+        }
+        if (width > cols) cols = width;
+        rows++;
+    }
+
+    // Ключи - тексты ячеек: строки без копии, числа и логические значения
+    // форматируются в общий буфер
+    const size_t row_slots = rows ? rows : 1;
+    const size_t cell_count = rows * cols;
+    char*** table = malloc(sizeof(char**) * row_slots + sizeof(char*) * (cell_count ? cell_count : 1));
+    cJSON** items = malloc(sizeof(cJSON*) * row_slots);
+    char (*texts)[32] = malloc(sizeof(*texts) * (numbers ? numbers : 1));
+    bool result = false;
+    if (!table || !items || !texts) {
+        free(table);
+        free(items);
+        free(texts);
+        return false;
+    }
+    char** cells = (char**)(table + row_slots);
+    size_t i = 0, next_text = 0;
+    cJSON_ArrayForEach(row, values) {
+        items[i] = cJSON_IsArray(row) ? row : NULL;
+        table[i] = cells + i * cols;
+        size_t j = 0;
+        cJSON* cell = NULL;
+        cJSON_ArrayForEach(cell, items[i]) {
+            char* text = "";
+            if (cJSON_IsString(cell)) {
+                text = cell->valuestring;
+            }
+            else if (cJSON_IsNumber(cell)) {
+                text = (char*)format_number(cell->valuedouble, texts[next_text++]);
+            }
+            else if (cJSON_IsBool(cell)) {
+                text = strcpy(texts[next_text++], cJSON_IsTrue(cell) ? "TRUE" : "FALSE");
+            }
+            table[i][j++] = text;
+        }
+        for (; j < cols; j++) table[i][j] = "";
+        i++;
+    }
+
+    SheetRange key_range = { .data = table, .rows = rows, .cols = cols };
+    GSheetView* view = gsheet_view_create(&key_range);
+    if (view && view_sort_from(view, header_rows, keys, key_count)) {
+        // Строки в новом порядке, каждая дополнена "" до ширины диапазона,
+        // иначе короткая строка оставила бы в ячейках справа старые значения
+        GSheetText text = { 0 };
+        gsheet_internal_text_append(&text, "{\"values\":[", 11);
+        for (size_t k = 0; k < rows && !text.failed; k++) {
+            gsheet_internal_text_append(&text, k ? ",[" : "[", k ? 2 : 1);
+            size_t j = 0;
+            cJSON* row_cells = items[view->rows[k]];
+            cJSON* cell = NULL;
+            cJSON_ArrayForEach(cell, row_cells) {
+                if (j++) gsheet_internal_text_append(&text, ",", 1);
+                if (cJSON_IsString(cell)) gsheet_internal_text_put_string(&text, cell->valuestring);
+                else if (cJSON_IsNumber(cell)) gsheet_internal_text_put_number(&text, cell->valuedouble);
+                else if (cJSON_IsTrue(cell)) gsheet_internal_text_append(&text, "true", 4);
+                else if (cJSON_IsFalse(cell)) gsheet_internal_text_append(&text, "false", 5);
+                else gsheet_internal_text_append(&text, "\"\"", 2);
+            }
+            for (; j < cols; j++) gsheet_internal_text_append(&text, j ? ",\"\"" : "\"\"", j ? 3 : 2);
+            gsheet_internal_text_append(&text, "]", 1);
+        }
+        gsheet_internal_text_append(&text, "]}", 2);
+
+        if (text.failed) {
+            fprintf(stderr, "Out of memory while building payload\n");
+        }
+        else {
+            char url[1024];
+            long http_code = 0;
+            snprintf(url, sizeof(url),
+                "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s?valueInputOption=RAW",
+                client->spreadsheet_id, range);
+            GSheetConnection* connection = gsheet_connection_acquire(client);
+            if (connection) {
+                CURLcode res = gsheet_http_request(client, connection, "PUT", url, text.data, &http_code);
+                gsheet_connection_release(client, connection);
+                result = (res == CURLE_OK && http_code == 200);
+            }
+            if (!result) fprintf(stderr, "Write failed. HTTP Code: %ld\n", http_code);
+        }
+        gsheet_mem_free(text.data);
+    }
+    gsheet_view_free(view);
+    free(texts);
+    free(items);
+    free(table);
+    return result;
+}
+
+bool gsheet_sort_write_back(GSheetClient* client, const char* range,
+                            const GSheetSortKey* keys, size_t key_count, size_t header_rows) {
+    if (!client || !range) return false;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    char url[1024];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s"
+        "?valueRenderOption=FORMULA&dateTimeRenderOption=SERIAL_NUMBER",
+        client->spreadsheet_id, range);
+
+    long http_code = 0;
+    cJSON* root = NULL;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (connection) {
+        CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+        if (res == CURLE_OK && http_code == 200) {
+            root = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        }
+        gsheet_connection_release(client, connection);
+    }
+
+    bool result = false;
+    cJSON* values = NULL;
+    if (http_code == 200 && gsheet_response_values(client, root, &values)) {
+        result = sort_write_back_values(client, range, values, keys, key_count, header_rows);
+    }
+    cJSON_Delete(root);
+    gsheet_alloc_leave(previous_scope);
+    return result;
+}
+
+// 30. Типизированные схемы: строки листа прямо в структуры (gsheet_schema.h)
+
+void gsheet_internal_text_append(GSheetText* text, const char* data, size_t len) {
+    if (text->failed) return;
+    if (text->len + len + 1 > text->cap) {
+        size_t cap = text->cap ? text->cap : 4096;
+        while (cap < text->len + len + 1) cap *= 2;
+        char* grown = gsheet_realloc(text->data, cap);
+        if (!grown) {
+            text->failed = 1;
+            return;
+        }
+        text->data = grown;
+        text->cap = cap;
+    }
+    memcpy(text->data + text->len, data, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+}
+
+// Строка JSON: экранируются кавычки, обратная косая черта и управляющие
+// символы, остальное копируется участками
+void gsheet_internal_text_put_string(GSheetText* text, const char* value) {
+    static const char hex[] = "0123456789abcdef";
+    gsheet_internal_text_append(text, "\"", 1);
+    const char* run = value;
+    for (const char* p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        gsheet_internal_text_append(text, run, (size_t)(p - run));
+        char escape[6] = { '\\', (char)c, 0, 0, 0, 0 };
+        size_t escape_len = 2;
+        if (c == '\n') escape[1] = 'n';
+        else if (c == '\r') escape[1] = 'r';
+        else if (c == '\t') escape[1] = 't';
+        else if (c < 0x20) {
+            memcpy(escape + 1, "u00", 3);
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 15];
+            escape_len = 6;
+        }
+        gsheet_internal_text_append(text, escape, escape_len);
+        run = p + 1;
+    }
+    gsheet_internal_text_append(text, run, strlen(run));
+    gsheet_internal_text_append(text, "\"", 1);
+}
+
+void gsheet_internal_text_put_number(GSheetText* text, double value) {
+    if (!isfinite(value)) {
+        gsheet_internal_text_append(text, "\"\"", 2);
+        return;
+    }
+    char number[32];
+    format_number(value, number);
+    gsheet_internal_text_append(text, number, strlen(number));
+}
+
+void gsheet_internal_text_put_int(GSheetText* text, long long value) {
+    char number[32];
+    int len = snprintf(number, sizeof(number), "%lld", value);
+    gsheet_internal_text_append(text, number, (size_t)len);
+}
+
+char* gsheet_internal_cell_text(const cJSON* cell) {
+    char number[32];
+    if (cJSON_IsNumber(cell)) return gsheet_strdup(format_number(cell->valuedouble, number));
+    return gsheet_strdup(cJSON_IsTrue(cell) ? "TRUE" : "FALSE");
+}
+
+// Чтение range в массив структур схемы. Значения без форматирования
+// (числа - числами, даты - серийными номерами); массив строк выделяется
+// одним блоком. Пустой диапазон - массив нулевой длины, NULL - ошибка
+void* gsheet_read_typed(GSheetClient* client, const char* range,
+                        const GSheetRowCodec* codec, size_t* count) {
+    if (count) *count = 0;
+    if (!client || !range || !codec) return NULL;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    long http_code = 0;
+    char url[1024];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s"
+        "?valueRenderOption=UNFORMATTED_VALUE&dateTimeRenderOption=SERIAL_NUMBER",
+        client->spreadsheet_id, range);
+
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (!connection) {
+        gsheet_alloc_leave(previous_scope);
+        return NULL;
+    }
+    CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+
+    char* rows = NULL;
+    if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+        uint64_t parse_start = gsheet_now_us();
+        cJSON* root = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        gsheet_histogram_observe(&client->metrics.timers[GSHEET_TIMER_PARSE], gsheet_now_us() - parse_start);
+        // {"error": ...} - NULL, а не пустой массив: иначе не отличить от пустого листа
+        cJSON* values = NULL;
+        if (gsheet_response_values(client, root, &values)) {
+            uint64_t build_start = gsheet_now_us();
+            // Пустой диапазон приходит без поля values
+            size_t row_count = (size_t)cJSON_GetArraySize(values);
+            if (row_count > SIZE_MAX / codec->row_size - 1) {
+                fprintf(stderr, "Range too large: %zu rows\n", row_count);
+            }
+            else {
+                size_t bytes = codec->row_size * (row_count ? row_count : 1);
+                rows = gsheet_malloc(bytes);
+                if (!rows) {
+                    fprintf(stderr, "Out of memory while building range\n");
+                }
+                else {
+                    memset(rows, 0, bytes);
+                    size_t i = 0;
+                    cJSON* row = NULL;
+                    cJSON_ArrayForEach(row, values) {
+                        codec->decode_row(row, rows + codec->row_size * i++);
+                    }
+                    if (count) *count = row_count;
+                }
+            }
+            gsheet_histogram_observe(&client->metrics.timers[GSHEET_TIMER_BUILD], gsheet_now_us() - build_start);
+        }
+        cJSON_Delete(root);
+    }
+
+    gsheet_connection_release(client, connection);
+    gsheet_alloc_leave(previous_scope);
+    return rows;
+}
+
+// Запись массива структур схемы с левого верхнего угла range. Тело
+// {"values":[[...],...]} пишется кодеком прямо в буфер, без дерева cJSON
+bool gsheet_write_typed(GSheetClient* client, const char* range,
+                        const GSheetRowCodec* codec, const void* rows, size_t count) {
+    if (!client || !range || !codec || (!rows && count)) return false;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    char url[1024];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values/%s?valueInputOption=RAW",
+        client->spreadsheet_id, range);
+
+    GSheetText text = { 0 };
+    gsheet_internal_text_append(&text, "{\"values\":[", 11);
+    for (size_t i = 0; i < count && !text.failed; i++) {
+        if (i) gsheet_internal_text_append(&text, ",", 1);
+        gsheet_internal_text_append(&text, "[", 1);
+        codec->encode_row(&text, (const char*)rows + codec->row_size * i);
+        // Кодек ставит ',' после каждого поля: последняя закрывает строку
+        if (!text.failed && text.data[text.len - 1] == ',') text.data[text.len - 1] = ']';
+        else gsheet_internal_text_append(&text, "]", 1);
+    }
+    gsheet_internal_text_append(&text, "]}", 2);
+
+    bool success = false;
+    if (text.failed) {
+        fprintf(stderr, "Out of memory while building payload\n");
+    }
+    else {
+        long http_code = 0;
+        GSheetConnection* connection = gsheet_connection_acquire(client);
+        if (connection) {
+            CURLcode res = gsheet_http_request(client, connection, "PUT", url, text.data, &http_code);
+            gsheet_connection_release(client, connection);
+            success = (res == CURLE_OK && http_code == 200);
+        }
+        if (!success) fprintf(stderr, "Write failed. HTTP Code: %ld\n", http_code);
+    }
+
+    gsheet_mem_free(text.data);
+    gsheet_alloc_leave(previous_scope);
+    return success;
+}
+
+// Освобождение массива, полученного gsheet_read_typed (строки полей - тоже)
+void gsheet_free_typed(GSheetClient* client, const GSheetRowCodec* codec, void* rows, size_t count) {
+    if (!client || !codec || !rows) return;
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    for (size_t i = 0; i < count; i++) {
+        codec->free_row((char*)rows + codec->row_size * i, gsheet_mem_free);
+    }
+    gsheet_mem_free(rows);
+    gsheet_alloc_leave(previous_scope);
+}
+
+// 31. Оптимистичная запись: проверка прочитанных диапазонов перед записью
+// Воркер запоминает хеши прочитанных диапазонов (GSheetReadSet), а перед
+// записью одним values:batchGet сверяет их с текущим содержимым листа.
+// Если кто-то успел изменить прочитанное, запись не выполняется и
+// возвращается GSHEET_COMMIT_CONFLICT с подробностями. Sheets API не умеет
+// условную запись, поэтому между проверкой и записью остаётся окно в один
+// запрос - оно много меньше, чем между чтением и записью
+
+typedef struct {
+    char* range;
+    uint64_t hash;
+} ReadSetEntry;
+
+// Набор прочитанных диапазонов одного воркера (не потокобезопасен)
+typedef struct GSheetReadSet {
+    ReadSetEntry* entries;
+    size_t count;
+    size_t cap;
+} GSheetReadSet;
+
+#define OPTIMISTIC_FNV_OFFSET 14695981039346656037ULL
+#define OPTIMISTIC_FNV_PRIME 1099511628211ULL
+
+static uint64_t optimistic_mix(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= OPTIMISTIC_FNV_PRIME;
+    }
+    return hash;
+}
+
+// Хеш диапазона не зависит от того, как API обрезал пустые ячейки: в
+// ответе нет хвостовых пустых ячеек строки и пустых строк в конце, а
+// SheetRange дополняет строки до прямоугольника пустыми строками
+typedef struct {
+    uint64_t hash;        // хеш диапазона
+    uint64_t row_hash;    // хеш текущей строки
+    size_t done;          // ячеек строки уже учтено (до последней непустой)
+} OptimisticHash;
+
+static void optimistic_cell(OptimisticHash* state, size_t column, const char* text) {
+    if (!text || !*text) return;
+    // Разделитель 0x1F перед каждой ячейкой, кроме первой, в том числе
+    // перед пропущенными пустыми
+    size_t separators = state->done ? column - state->done + 1 : column;
+    for (size_t k = 0; k < separators; k++) {
+        state->row_hash ^= 0x1F;
+        state->row_hash *= OPTIMISTIC_FNV_PRIME;
+    }
+    state->row_hash = optimistic_mix(state->row_hash, text, strlen(text));
+    state->done = column + 1;
+}
+
+static void optimistic_row_end(OptimisticHash* state, uint64_t row) {
+    // Пустые строки не учитываются, номер строки - учитывается
+    if (state->done) {
+        state->hash = optimistic_mix(state->hash, &row, sizeof(row));
+        state->hash = optimistic_mix(state->hash, &state->row_hash, sizeof(state->row_hash));
+    }
+    state->row_hash = OPTIMISTIC_FNV_OFFSET;
+    state->done = 0;
+}
+
+static uint64_t optimistic_hash_range(const SheetRange* data) {
+    OptimisticHash state = { OPTIMISTIC_FNV_OFFSET, OPTIMISTIC_FNV_OFFSET, 0 };
+    for (size_t i = 0; data && i < data->rows; i++) {
+        for (size_t j = 0; j < data->cols; j++) optimistic_cell(&state, j, data->data[i][j]);
+        optimistic_row_end(&state, i);
+    }
+    return state.hash;
+}
+
+// Тот же хеш по массиву values из ответа, без сборки SheetRange
+static uint64_t optimistic_hash_values(const cJSON* values) {
+    OptimisticHash state = { OPTIMISTIC_FNV_OFFSET, OPTIMISTIC_FNV_OFFSET, 0 };
+    uint64_t i = 0;
+    const cJSON* row = NULL;
+    cJSON_ArrayForEach(row, values) {
+        size_t j = 0;
+        const cJSON* cell = NULL;
+        const cJSON* row_cells = cJSON_IsArray(row) ? row : NULL;
+        cJSON_ArrayForEach(cell, row_cells) {
+            char number[32];
+            const char* text = NULL;
+            // Как в sheet_range_from_values
+            if (cJSON_IsString(cell)) text = cell->valuestring;
+            else if (cJSON_IsNumber(cell)) text = format_number(cell->valuedouble, number);
+            else if (cJSON_IsBool(cell)) text = cJSON_IsTrue(cell) ? "TRUE" : "FALSE";
+            optimistic_cell(&state, j++, text);
+        }
+        optimistic_row_end(&state, i++);
+    }
+    return state.hash;
+}
+
+GSheetReadSet* gsheet_readset_create(void) {
+    GSheetReadSet* set = calloc(1, sizeof(GSheetReadSet));
+    if (!set) fprintf(stderr, "Out of memory while creating read set\n");
+    return set;
+}
+
+void gsheet_readset_reset(GSheetReadSet* set) {
+    if (!set) return;
+    for (size_t i = 0; i < set->count; i++) free(set->entries[i].range);
+    set->count = 0;
+}
+
+void gsheet_readset_free(GSheetReadSet* set) {
+    if (!set) return;
+    gsheet_readset_reset(set);
+    free(set->entries);
+    free(set);
+}
+
+// Запомнить содержимое диапазона, прочитанного как угодно (например,
+// шардированным чтением). Повторное добавление того же range заменяет хеш
+bool gsheet_readset_add(GSheetReadSet* set, const char* range, const SheetRange* data) {
+    if (!set || !range) return false;
+    const uint64_t hash = optimistic_hash_range(data);
+    for (size_t i = 0; i < set->count; i++) {
+        if (strcmp(set->entries[i].range, range) == 0) {
+            set->entries[i].hash = hash;
+            return true;
+        }
+    }
+
+    if (set->count == set->cap) {
+        size_t cap = set->cap ? set->cap * 2 : 8;
+        ReadSetEntry* grown = realloc(set->entries, sizeof(ReadSetEntry) * cap);
+        if (!grown) {
+            fprintf(stderr, "Out of memory while tracking range %s\n", range);
+            return false;
+        }
+        set->entries = grown;
+        set->cap = cap;
+    }
+    char* copy = strdup(range);
+    if (!copy) {
+        fprintf(stderr, "Out of memory while tracking range %s\n", range);
+        return false;
+    }
+    set->entries[set->count].range = copy;
+    set->entries[set->count].hash = hash;
+    set->count++;
+    return true;
+}
+
+// Чтение с запоминанием в наборе
+SheetRange* gsheet_read_range_tracked(GSheetClient* client, GSheetReadSet* set, const char* range) {
+    SheetRange* data = gsheet_read_range(client, range);
+    if (data && !gsheet_readset_add(set, range, data)) {
+        gsheet_free_range(data);
+        return NULL;
+    }
+    return data;
+}
+
+void gsheet_conflict_clear(GSheetConflict* conflict) {
+    if (!conflict) return;
+    if (conflict->current) gsheet_free_range(conflict->current);
+    memset(conflict, 0, sizeof(GSheetConflict));
+}
+
+// Проверка всех диапазонов набора одним values:batchGet
+GSheetCommitStatus gsheet_verify_reads(GSheetClient* client, const GSheetReadSet* set, GSheetConflict* conflict) {
+    if (conflict) memset(conflict, 0, sizeof(GSheetConflict));
+    if (!client || !set) return GSHEET_COMMIT_ERROR;
+    if (set->count == 0) return GSHEET_COMMIT_OK;
+
+    // Диапазоны экранируются: пробел, &, # или ' в имени листа иначе
+    // ломают URL или делят его на чужие параметры
+    char** escaped = calloc(set->count, sizeof(char*));
+    size_t url_len = 128 + strlen(client->spreadsheet_id);
+    bool escaped_all = escaped != NULL;
+    for (size_t i = 0; escaped_all && i < set->count; i++) {
+        escaped[i] = curl_easy_escape(NULL, set->entries[i].range, 0);
+        if (escaped[i]) url_len += strlen(escaped[i]) + 8;
+        else escaped_all = false;
+    }
+    char* url = escaped_all ? malloc(url_len) : NULL;
+    if (url) {
+        size_t pos = (size_t)snprintf(url, url_len,
+            "https://sheets.googleapis.com/v4/spreadsheets/%s/values:batchGet",
+            client->spreadsheet_id);
+        for (size_t i = 0; i < set->count; i++) {
+            pos += (size_t)snprintf(url + pos, url_len - pos, "%cranges=%s", i ? '&' : '?', escaped[i]);
+        }
+    }
+    for (size_t i = 0; escaped && i < set->count; i++) curl_free(escaped[i]);
+    free(escaped);
+    if (!url) {
+        fprintf(stderr, "Out of memory while verifying reads\n");
+        return GSHEET_COMMIT_ERROR;
+    }
+
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    GSheetCommitStatus status = GSHEET_COMMIT_ERROR;
+    long http_code = 0;
+    GSheetConnection* connection = gsheet_connection_acquire(client);
+    if (connection) {
+        CURLcode res = gsheet_http_request(client, connection, "GET", url, NULL, &http_code);
+        cJSON* root = NULL;
+        if (res == CURLE_OK && http_code == 200 && connection->body.len) {
+            root = cJSON_ParseWithLength(connection->body.data, connection->body.len);
+        }
+        cJSON* value_ranges = cJSON_GetObjectItem(root, "valueRanges");
+        if (!root) {
+            fprintf(stderr, "Verify failed. HTTP Code: %ld\n", http_code);
+        }
+        else if ((size_t)cJSON_GetArraySize(value_ranges) != set->count) {
+            fprintf(stderr, "Verify failed: %d ranges in response, %zu expected\n",
+                cJSON_GetArraySize(value_ranges), set->count);
+        }
+        else {
+            // valueRanges идут в порядке параметров ranges
+            status = GSHEET_COMMIT_OK;
+            size_t i = 0;
+            cJSON* value_range = NULL;
+            cJSON_ArrayForEach(value_range, value_ranges) {
+                const ReadSetEntry* entry = &set->entries[i];
+                cJSON* values = cJSON_GetObjectItem(value_range, "values");
+                const uint64_t actual = optimistic_hash_values(values);
+                if (actual != entry->hash) {
+                    if (status == GSHEET_COMMIT_OK && conflict) {
+                        snprintf(conflict->range, sizeof(conflict->range), "%s", entry->range);
+                        conflict->index = i;
+                        conflict->expected_hash = entry->hash;
+                        conflict->actual_hash = actual;
+                        conflict->current = sheet_range_from_values(client, values);
+                    }
+                    status = GSHEET_COMMIT_CONFLICT;
+                    if (conflict) conflict->changed++;
+                }
+                i++;
+            }
+        }
+        cJSON_Delete(root);
+        gsheet_connection_release(client, connection);
+    }
+
+    gsheet_alloc_leave(previous_scope);
+    free(url);
+    return status;
+}
+
+// Проверка набора и запись пакета одним values:batchUpdate. Набор после
+// успешной записи не меняется: для следующей транзакции его нужно сбросить
+// (gsheet_readset_reset) и перечитать
+GSheetCommitStatus gsheet_commit_writes(GSheetClient* client, const GSheetReadSet* set,
+                                        const GSheetWrite* writes, size_t count, GSheetConflict* conflict) {
+    if (!client || !set || (!writes && count)) return GSHEET_COMMIT_ERROR;
+    GSheetCommitStatus status = gsheet_verify_reads(client, set, conflict);
+    if (status != GSHEET_COMMIT_OK || count == 0) return status;
+
+    const GSheetAllocScope* previous_scope = gsheet_alloc_enter(&client->alloc_scope);
+    char url[256];
+    snprintf(url, sizeof(url),
+        "https://sheets.googleapis.com/v4/spreadsheets/%s/values:batchUpdate",
+        client->spreadsheet_id);
+
+    // {"valueInputOption":"RAW","data":[{"range":...,"values":[[...]]}, ...]}
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "valueInputOption", "RAW");
+    cJSON* data = cJSON_AddArrayToObject(root, "data");
+    for (size_t k = 0; k < count; k++) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "range", writes[k].range);
+        cJSON* values = cJSON_AddArrayToObject(item, "values");
+        const SheetRange* range_data = writes[k].data;
+        for (size_t i = 0; range_data && i < range_data->rows; i++) {
+            cJSON* row = cJSON_CreateArray();
+            for (size_t j = 0; j < range_data->cols; j++) {
+                cJSON_AddItemToArray(row, cJSON_CreateString(range_data->data[i][j]));
+            }
+            cJSON_AddItemToArray(values, row);
+        }
+        cJSON_AddItemToArray(data, item);
+    }
+    char* payload = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    status = GSHEET_COMMIT_ERROR;
+    long http_code = 0;
+    GSheetConnection* connection = payload ? gsheet_connection_acquire(client) : NULL;
+    if (connection) {
+        CURLcode res = gsheet_http_request(client, connection, "POST", url, payload, &http_code);
+        gsheet_connection_release(client, connection);
+        if (res == CURLE_OK && http_code == 200) status = GSHEET_COMMIT_OK;
+    }
+    if (status != GSHEET_COMMIT_OK) {
+        fprintf(stderr, "Write failed. HTTP Code: %ld\n", http_code);
+    }
+
+    gsheet_mem_free(payload);
+    gsheet_alloc_leave(previous_scope);
+    return status;
+}
+
+// Запись одного диапазона при условии, что прочитанное не изменилось
+GSheetCommitStatus gsheet_write_range_checked(GSheetClient* client, const GSheetReadSet* set,
+                                              const char* range, const SheetRange* data, GSheetConflict* conflict) {
+    GSheetWrite write = { range, data };
+    return gsheet_commit_writes(client, set, &write, 1, conflict);
 }
\ No newline at end of file
@@ -0,0 +1,340 @@
+#ifndef GOOGLE_SHEETS_H
+#define GOOGLE_SHEETS_H
+
+// Клиент Google Sheets API v4 (libgsheets)
+//
+// Все функции, принимающие GSheetClient, можно вызывать из разных потоков
+// для разных клиентов; один клиент допускает параллельные запросы (пул
+// соединений клиента защищён мьютексом). Объекты GSheetView, GSheetCalc,
+// GSheetReadSet и GSheetArena не потокобезопасны.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <cJSON.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct GSheetClient GSheetClient;
+
+// Аллокатор. Все буферы, строки, узлы cJSON и SheetRange клиента выделяются
+// через него; нулевая структура означает malloc/realloc/free
+typedef struct {
+    void* (*malloc_fn)(void* ctx, size_t size);
+    void* (*realloc_fn)(void* ctx, void* ptr, size_t size);
+    void (*free_fn)(void* ctx, void* ptr);
+    void* ctx;
+} GSheetAllocator;
+
+typedef struct {
+    char*** data;
+    size_t rows;
+    size_t cols;
+    GSheetAllocator allocator;  // чем выделены data и ячейки (нули - malloc)
+    bool row_block;             // строки data[i] лежат в одном блоке с data
+} SheetRange;
+
+// Ключ локальной сортировки
+typedef enum {
+    GSHEET_SORT_AUTO,       // как в Google Sheets: числа, затем текст без учёта регистра
+    GSHEET_SORT_NUMBER,     // нечисловые значения - в конец, как пустые
+    GSHEET_SORT_TEXT        // побайтово
+} GSheetSortType;
+
+typedef struct {
+    size_t column;
+    GSheetSortType type;
+    bool descending;
+} GSheetSortKey;
+
+// Клиент и основные методы
+GSheetClient* gsheet_init(const char* access_token, const char* spreadsheet_id);
+void gsheet_free(GSheetClient* client);
+void gsheet_free_range(SheetRange* range);
+
+SheetRange* gsheet_read_range(GSheetClient* client, const char* range);
+bool gsheet_write_range(GSheetClient* client, const char* range, SheetRange* data);
+char* gsheet_create_spreadsheet(GSheetClient* client, const char* title);
+bool gsheet_add_sheet(GSheetClient* client, const char* sheet_title);
+void gsheet_get_sheet_info(GSheetClient* client);
+bool gsheet_clear_range(GSheetClient* client, const char* range);
+bool gsheet_delete_row(GSheetClient* client, int sheet_id, int row);
+bool gsheet_rename_sheet(GSheetClient* client, int sheet_id, const char* new_name);
+void gsheet_get_history(GSheetClient* client);
+bool gsheet_format_cell(GSheetClient* client, int sheet_id, const char* cell, int bg_color);
+bool gsheet_batch_update(GSheetClient* client, cJSON* requests);
+void gsheet_delete_sheet(GSheetClient* client, int sheet_id);
+SheetRange* gsheet_read_cell(GSheetClient* client, int row, int col);
+bool gsheet_append_row(GSheetClient* client, const char* sheet_name, char*** row_data, size_t cols);
+int gsheet_sort_range(GSheetClient* client, const char* range, int column_index);
+bool gsheet_set_formula(GSheetClient* client, const char* cell, char*** formula);
+int gsheet_merge_cells(GSheetClient* client, const char* range);
+char** gsheet_search(GSheetClient* client, const char* query, int* result_count);
+bool gsheet_export_csv(GSheetClient* client, const char* range, const char* filename);
+
+// Подменный транспорт: обработчик отвечает на запросы вместо сети. Возвращает
+// HTTP-статус (0 - сетевая ошибка) и тело ответа в *response/*response_len;
+// тело копируется в буфер соединения сразу после вызова. При работе через пул
+// задач обработчик вызывается из нескольких потоков
+typedef long (*GSheetMockHandler)(void* user, const char* method, const char* url,
+                                  const char* payload, const char** response, size_t* response_len);
+
+bool gsheet_set_mock_transport(GSheetClient* client, GSheetMockHandler handler, void* user);
+
+// Снимок диапазона на диске
+typedef struct GSheetSnapshot GSheetSnapshot;
+
+bool gsheet_snapshot_save(const SheetRange* range, const char* path, uint64_t revision);
+GSheetSnapshot* gsheet_snapshot_open(const char* path);
+void gsheet_snapshot_close(GSheetSnapshot* snap);
+size_t gsheet_snapshot_rows(const GSheetSnapshot* snap);
+size_t gsheet_snapshot_cols(const GSheetSnapshot* snap);
+uint64_t gsheet_snapshot_revision(const GSheetSnapshot* snap);
+time_t gsheet_snapshot_created_at(const GSheetSnapshot* snap);
+const char* gsheet_snapshot_cell(const GSheetSnapshot* snap, size_t row, size_t col, size_t* len);
+const double* gsheet_snapshot_numeric_column(const GSheetSnapshot* snap, size_t col);
+bool gsheet_snapshot_is_stale(const GSheetSnapshot* snap, uint64_t known_revision, time_t max_age);
+
+// Ревизия таблицы (Drive API), 0 - не удалось получить
+uint64_t gsheet_get_revision(GSheetClient* client);
+
+// Фоновая синхронизация
+typedef enum {
+    GSHEET_SYNC_INSERT,
+    GSHEET_SYNC_UPDATE,
+    GSHEET_SYNC_DELETE
+} GSheetSyncEventType;
+
+// Строки сопоставляются по хешу содержимого, а не по индексу: сдвинутая
+// вставкой или удалением строка события не даёт, изменённая даёт UPDATE.
+// Ключевой колонки нет, поэтому строка, изменённая одновременно со вставкой
+// рядом, может прийти как UPDATE соседней строки. Диапазон перечитывается
+// целиком, когда меняется ревизия таблицы (или её не удалось получить)
+typedef struct {
+    GSheetSyncEventType type;
+    GSheetClient* client;
+    const char* range;
+    size_t row;             // индекс в новом чтении, для DELETE - в предыдущем
+    char** cells;           // новое содержимое строки, NULL для DELETE
+    size_t cols;
+} GSheetSyncEvent;
+
+// Вызывается в рабочем потоке синхронизации
+typedef void (*GSheetSyncCallback)(const GSheetSyncEvent* event, void* userdata);
+
+typedef struct GSheetSyncEngine GSheetSyncEngine;
+
+GSheetSyncEngine* gsheet_sync_create(uint64_t interval_ms, uint64_t jitter_ms,
+                                     GSheetSyncCallback callback, void* userdata);
+bool gsheet_sync_add(GSheetSyncEngine* engine, GSheetClient* client, const char* range);
+bool gsheet_sync_start(GSheetSyncEngine* engine);
+void gsheet_sync_stop(GSheetSyncEngine* engine);
+void gsheet_sync_free(GSheetSyncEngine* engine);
+
+// Метрики
+// Гистограмма с логарифмическими корзинами: корзина k считает значения <= 2^k мкс
+#define GSHEET_HISTOGRAM_BUCKETS 32
+
+typedef enum {
+    GSHEET_TIMER_DNS,
+    GSHEET_TIMER_CONNECT,
+    GSHEET_TIMER_TLS,
+    GSHEET_TIMER_TTFB,
+    GSHEET_TIMER_TOTAL,
+    GSHEET_TIMER_PARSE,
+    GSHEET_TIMER_BUILD,
+    GSHEET_TIMER_COUNT
+} GSheetTimer;
+
+// Обычная (не volatile) копия метрик на момент вызова
+typedef struct {
+    uint64_t buckets[GSHEET_TIMER_COUNT][GSHEET_HISTOGRAM_BUCKETS];
+    uint64_t count[GSHEET_TIMER_COUNT];
+    uint64_t sum_us[GSHEET_TIMER_COUNT];
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t retries;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t allocations;
+} GSheetMetricsSnapshot;
+
+void gsheet_set_verbose(GSheetClient* client, bool enabled);
+void gsheet_metrics_snapshot(GSheetClient* client, GSheetMetricsSnapshot* out);
+// Текстовый формат Prometheus. Строку освобождает вызывающий код (free)
+char* gsheet_metrics_prometheus(GSheetClient* client);
+
+// Аллокаторы и арена
+typedef struct GSheetArena GSheetArena;
+
+void gsheet_set_allocator(GSheetClient* client, const GSheetAllocator* allocator);
+// Библиотека владеет хуками cJSON: первый gsheet_init ставит через
+// cJSON_InitHooks свои функции, а хуки, поставленные приложением раньше,
+// теряются. Внутри вызова библиотеки узлы cJSON выделяет аллокатор клиента,
+// вне вызовов - функции из gsheet_set_cjson_hooks (по умолчанию malloc/free).
+// Приложение, которому нужны свои хуки, вызывает эту функцию вместо
+// cJSON_InitHooks, до работы с cJSON в других потоках. Дерево cJSON нельзя
+// освобождать в другой области, чем создано: библиотека не освобождает
+// деревья вызывающего кода (gsheet_batch_update) и не отдаёт свои
+void gsheet_set_cjson_hooks(const cJSON_Hooks* hooks);
+GSheetArena* gsheet_arena_create(size_t block_size);
+void gsheet_arena_reset(GSheetArena* arena);
+void gsheet_arena_destroy(GSheetArena* arena);
+GSheetAllocator gsheet_arena_allocator(GSheetArena* arena);
+
+// Размер сетки листа и параллельное чтение полосами строк
+bool gsheet_get_grid_size(GSheetClient* client, const char* sheet_title, size_t* rows, size_t* cols);
+// band_rows == 0 - 5000 строк, concurrency <= 0 - 4 потока
+SheetRange* gsheet_read_sheet_sharded(GSheetClient* client, const char* sheet_title,
+                                      size_t band_rows, int concurrency);
+
+// Пул задач и асинхронные запросы
+typedef enum {
+    GSHEET_STAGE_BUILD,
+    GSHEET_STAGE_IO,
+    GSHEET_STAGE_PARSE,
+    GSHEET_STAGE_POST,
+    GSHEET_STAGE_COUNT
+} GSheetStage;
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t queued;             // ждут в очереди или выполняются
+    uint64_t wait_us;
+    uint64_t run_us;
+} GSheetStageStats;
+
+typedef struct {
+    size_t workers;
+    uint64_t steals;
+    GSheetStageStats stages[GSHEET_STAGE_COUNT];
+} GSheetPoolStats;
+
+typedef struct GSheetPool GSheetPool;
+
+typedef void (*GSheetReadCallback)(SheetRange* range, void* userdata);
+typedef void (*GSheetWriteCallback)(bool success, void* userdata);
+
+GSheetPool* gsheet_pool_create(size_t worker_count);
+// Ждёт все поставленные задачи. Нельзя вызывать из колбэка или задачи этого
+// же пула: такой вызов ничего не делает и пишет ошибку в stderr
+void gsheet_pool_destroy(GSheetPool* pool);
+void gsheet_pool_stats(GSheetPool* pool, GSheetPoolStats* out);
+void gsheet_attach_pool(GSheetClient* client, GSheetPool* pool);
+bool gsheet_read_range_async(GSheetClient* client, const char* range,
+                             GSheetReadCallback callback, void* userdata);
+bool gsheet_write_range_async(GSheetClient* client, const char* range, const SheetRange* data,
+                              GSheetWriteCallback callback, void* userdata);
+
+// Общий HTTP/2-транспорт для многих клиентов
+typedef struct GSheetTransport GSheetTransport;
+
+GSheetTransport* gsheet_transport_create(size_t max_connections, size_t max_streams, size_t per_client_streams);
+void gsheet_transport_destroy(GSheetTransport* transport);
+void gsheet_attach_transport(GSheetClient* client, GSheetTransport* transport);
+
+// Локальный пересчёт формул
+typedef enum {
+    GSHEET_VALUE_EMPTY,
+    GSHEET_VALUE_NUMBER,
+    GSHEET_VALUE_TEXT,
+    GSHEET_VALUE_BOOL,
+    GSHEET_VALUE_ERROR
+} GSheetValueType;
+
+// text - строка (TEXT) или код ошибки (ERROR), живёт до следующего изменения таблицы
+typedef struct {
+    GSheetValueType type;
+    double number;      // NUMBER, BOOL (0/1)
+    const char* text;
+} GSheetValue;
+
+typedef struct GSheetCalc GSheetCalc;
+
+SheetRange* gsheet_read_formulas(GSheetClient* client, const char* range);
+GSheetCalc* gsheet_calc_create(const SheetRange* formulas, const char* range);
+GSheetCalc* gsheet_calc_load(GSheetClient* client, const char* range);
+bool gsheet_calc_set(GSheetCalc* calc, const char* cell, const char* input);
+bool gsheet_calc_set_number(GSheetCalc* calc, const char* cell, double value);
+bool gsheet_calc_get(GSheetCalc* calc, const char* cell, GSheetValue* out);
+size_t gsheet_calc_recalc(GSheetCalc* calc);
+void gsheet_calc_free(GSheetCalc* calc);
+
+// Локальные запросы: сортировка, фильтр, проекция, top-k
+typedef struct GSheetView GSheetView;
+
+typedef enum {
+    GSHEET_FILTER_EQ,
+    GSHEET_FILTER_NE,
+    GSHEET_FILTER_LT,
+    GSHEET_FILTER_LE,
+    GSHEET_FILTER_GT,
+    GSHEET_FILTER_GE,
+    GSHEET_FILTER_CONTAINS,
+    GSHEET_FILTER_NOT_EMPTY
+} GSheetFilterOp;
+
+// row - строка source целиком (все столбцы source)
+typedef bool (*GSheetRowPredicate)(char** row, size_t cols, void* userdata);
+
+GSheetView* gsheet_view_create(const SheetRange* source);
+void gsheet_view_free(GSheetView* view);
+size_t gsheet_view_rows(const GSheetView* view);
+size_t gsheet_view_cols(const GSheetView* view);
+const char* gsheet_view_cell(const GSheetView* view, size_t row, size_t col);
+bool gsheet_view_sort(GSheetView* view, const GSheetSortKey* keys, size_t key_count);
+size_t gsheet_view_filter(GSheetView* view, GSheetRowPredicate predicate, void* userdata);
+size_t gsheet_view_filter_column(GSheetView* view, size_t column, GSheetFilterOp op, const char* value);
+bool gsheet_view_select(GSheetView* view, const size_t* columns, size_t count);
+bool gsheet_view_top_k(GSheetView* view, const GSheetSortKey* keys, size_t key_count, size_t k);
+bool gsheet_write_view(GSheetClient* client, const char* range, const GSheetView* view);
+bool gsheet_sort_write_back(GSheetClient* client, const char* range,
+                            const GSheetSortKey* keys, size_t key_count, size_t header_rows);
+
+// Оптимистичная запись
+typedef struct GSheetReadSet GSheetReadSet;
+
+typedef enum {
+    GSHEET_COMMIT_OK,
+    GSHEET_COMMIT_CONFLICT,   // прочитанное изменилось: перечитать и повторить
+    GSHEET_COMMIT_ERROR       // сеть, HTTP или память: повтор не поможет сразу
+} GSheetCommitStatus;
+
+// Подробности конфликта. current - текущее содержимое первого изменившегося
+// диапазона (уже получено при проверке), освобождается gsheet_conflict_clear
+typedef struct {
+    char range[256];          // первый изменившийся диапазон
+    size_t index;             // его номер в наборе (порядок добавления)
+    size_t changed;           // сколько диапазонов набора изменилось
+    uint64_t expected_hash;
+    uint64_t actual_hash;
+    SheetRange* current;
+} GSheetConflict;
+
+// Одна запись пакета
+typedef struct {
+    const char* range;
+    const SheetRange* data;
+} GSheetWrite;
+
+GSheetReadSet* gsheet_readset_create(void);
+void gsheet_readset_reset(GSheetReadSet* set);
+void gsheet_readset_free(GSheetReadSet* set);
+bool gsheet_readset_add(GSheetReadSet* set, const char* range, const SheetRange* data);
+SheetRange* gsheet_read_range_tracked(GSheetClient* client, GSheetReadSet* set, const char* range);
+void gsheet_conflict_clear(GSheetConflict* conflict);
+GSheetCommitStatus gsheet_verify_reads(GSheetClient* client, const GSheetReadSet* set, GSheetConflict* conflict);
+GSheetCommitStatus gsheet_commit_writes(GSheetClient* client, const GSheetReadSet* set,
+                                        const GSheetWrite* writes, size_t count, GSheetConflict* conflict);
+GSheetCommitStatus gsheet_write_range_checked(GSheetClient* client, const GSheetReadSet* set,
+                                              const char* range, const SheetRange* data, GSheetConflict* conflict);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GOOGLE_SHEETS_H
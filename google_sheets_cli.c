@@ -0,0 +1,502 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "google_sheets.h"
+#include "gsheet_schema.h"
+
+// Командная строка libgsheets
+//   google_sheets read <access_token> <spreadsheet_id> <range>
+//   google_sheets bench [iterations]
+//   google_sheets bench alloc [iterations]
+//   google_sheets bench sizes [iterations]
+//   google_sheets bench pool <workers> [requests] [latency_ms]
+// bench гоняет горячие пути разбора и сборки JSON через подменный транспорт,
+// без сети; им же обучается профиль для PGO (см. CMakePresets.json)
+
+#define BENCH_ROWS 2000
+#define BENCH_COLS 10
+#define BENCH_POOL_ROWS 200
+
+// Вспомогательная функция. Выводим спарсенные данные
+static void print_data_from_gsheet(SheetRange* data, const char* range) {
+    printf("Data from range %s:\n", range);
+    for (size_t i = 0; i < data->rows; i++) {
+        for (size_t j = 0; j < data->cols; j++) {
+            printf("%-20s", data->data[i][j]);
+        }
+        printf("\n");
+    }
+}
+
+static int cli_read(const char* access_token, const char* spreadsheet_id, const char* range) {
+    // Инициализация клиента
+    GSheetClient* client = gsheet_init(access_token, spreadsheet_id);
+    if (!client) {
+        fprintf(stderr, "Cannot init client\n");
+        return 1;
+    }
+
+    // Чтение данных из диапазона
+    SheetRange* data = gsheet_read_range(client, range);
+    if (!data) {
+        fprintf(stderr, "Cannot read data from gsheet\n");
+        gsheet_free(client);
+        return 1;
+    }
+
+    // Вывод данных в консоль
+    print_data_from_gsheet(data, range);
+
+    gsheet_free_range(data);
+    gsheet_free(client);
+    return 0;
+}
+
+// Ответы подменного транспорта собираются один раз
+typedef struct {
+    char* values;       // GET values: строки, числа, логические значения
+    char* unformatted;  // GET values с UNFORMATTED_VALUE: числа числами
+    char* batch;        // values:batchGet на один диапазон
+    size_t values_len;
+    size_t unformatted_len;
+    size_t batch_len;
+    int latency_ms;     // задержка ответа: имитация сети
+} BenchResponses;
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} BenchText;
+
+static int bench_append(BenchText* text, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, format);
+        int written = vsnprintf(text->data + text->len, text->cap - text->len, format, args);
+        va_end(args);
+        if (written < 0) return 0;
+        if ((size_t)written < text->cap - text->len) {
+            text->len += (size_t)written;
+            return 1;
+        }
+        size_t cap = text->cap ? text->cap * 2 : 65536;
+        while (cap < text->len + (size_t)written + 1) cap *= 2;
+        char* data = realloc(text->data, cap);
+        if (!data) return 0;
+        text->data = data;
+        text->cap = cap;
+    }
+}
+
+// Сетка rows x cols (cols >= 4): id, текст с экранированием, числа, дата, флаг
+static char* bench_values_json(int rows, int cols, int unformatted,
+                               const char* prefix, const char* suffix, size_t* len) {
+    BenchText text = { NULL, 0, 0 };
+    int ok = bench_append(&text, "%s{\"range\":\"Bench!A1:ZZ%d\",\"majorDimension\":\"ROWS\",\"values\":[",
+                          prefix, rows);
+    for (int i = 0; ok && i < rows; i++) {
+        ok = bench_append(&text, "%s[\"id%d\",\"item \\\"%d\\\"\\n\"", i ? "," : "", i, i % 97);
+        for (int j = 2; ok && j < cols - 2; j++) {
+            double value = (i * 31 + j * 7) % 1000 / 8.0;
+            ok = unformatted ? bench_append(&text, ",%g", value) : bench_append(&text, ",\"%g\"", value);
+        }
+        if (ok) ok = unformatted
+            ? bench_append(&text, ",%d.5,%s]", 45000 + i % 365, i % 3 ? "true" : "false")
+            : bench_append(&text, ",\"%d.5\",\"%s\"]", 45000 + i % 365, i % 3 ? "TRUE" : "FALSE");
+    }
+    if (ok) ok = bench_append(&text, "]}%s", suffix);
+    if (!ok) {
+        free(text.data);
+        return NULL;
+    }
+    *len = text.len;
+    return text.data;
+}
+
+static void bench_responses_free(BenchResponses* responses) {
+    free(responses->values);
+    free(responses->unformatted);
+    free(responses->batch);
+}
+
+static int bench_responses_init(BenchResponses* responses, int rows, int cols) {
+    memset(responses, 0, sizeof(*responses));
+    responses->values = bench_values_json(rows, cols, 0, "", "", &responses->values_len);
+    responses->unformatted = bench_values_json(rows, cols, 1, "", "", &responses->unformatted_len);
+    responses->batch = bench_values_json(rows, cols, 0, "{\"spreadsheetId\":\"bench\",\"valueRanges\":[", "]}",
+                                         &responses->batch_len);
+    if (responses->values && responses->unformatted && responses->batch) return 1;
+    bench_responses_free(responses);
+    return 0;
+}
+
+static void bench_sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec delay;
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&delay, NULL);
+#endif
+}
+
+static long bench_handler(void* user, const char* method, const char* url,
+                          const char* payload, const char** response, size_t* response_len) {
+    const BenchResponses* responses = user;
+    (void)payload;
+    if (responses->latency_ms > 0) bench_sleep_ms(responses->latency_ms);
+    if (strcmp(method, "GET") != 0) {
+        *response = "{}";
+        *response_len = 2;
+    }
+    else if (strstr(url, "values:batchGet")) {
+        *response = responses->batch;
+        *response_len = responses->batch_len;
+    }
+    else if (strstr(url, "UNFORMATTED_VALUE")) {
+        *response = responses->unformatted;
+        *response_len = responses->unformatted_len;
+    }
+    else {
+        *response = responses->values;
+        *response_len = responses->values_len;
+    }
+    return 200;
+}
+
+// Клиент без сети: все запросы обслуживает bench_handler
+static GSheetClient* bench_client(BenchResponses* responses) {
+    GSheetClient* client = gsheet_init("bench", "bench");
+    if (client && gsheet_set_mock_transport(client, bench_handler, responses)) return client;
+    gsheet_free(client);
+    return NULL;
+}
+
+#define BENCH_FIELDS(X) \
+    X(STRING, id)       \
+    X(STRING, name)     \
+    X(DOUBLE, c)        \
+    X(DOUBLE, d)        \
+    X(DOUBLE, e)        \
+    X(DOUBLE, f)        \
+    X(DOUBLE, g)        \
+    X(DOUBLE, h)        \
+    X(DATE, ts)         \
+    X(BOOL, flag)
+GSHEET_SCHEMA(BenchRow, BENCH_FIELDS)
+
+static double bench_seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench_report(const char* name, double seconds, int iterations) {
+    printf("%-14s %9.3f ms/iter\n", name, seconds * 1000.0 / iterations);
+}
+
+static int cli_bench(int iterations) {
+    BenchResponses responses;
+    if (!bench_responses_init(&responses, BENCH_ROWS, BENCH_COLS)) {
+        fprintf(stderr, "Cannot prepare benchmark\n");
+        return 1;
+    }
+    GSheetClient* client = bench_client(&responses);
+    if (!client) {
+        fprintf(stderr, "Cannot prepare benchmark\n");
+        bench_responses_free(&responses);
+        return 1;
+    }
+
+    printf("%d x %d cells, %d iterations\n", BENCH_ROWS, BENCH_COLS, iterations);
+    int ok = 1;
+
+    // JSON -> SheetRange
+    double start = bench_seconds();
+    for (int i = 0; ok && i < iterations; i++) {
+        SheetRange* data = gsheet_read_range(client, "Bench!A1:J");
+        ok = data != NULL;
+        gsheet_free_range(data);
+    }
+    bench_report("read", bench_seconds() - start, iterations);
+
+    // SheetRange -> JSON
+    SheetRange* data = gsheet_read_range(client, "Bench!A1:J");
+    ok = ok && data;
+    start = bench_seconds();
+    for (int i = 0; ok && i < iterations; i++) ok = gsheet_write_range(client, "Bench!A1", data);
+    bench_report("write", bench_seconds() - start, iterations);
+
+    // Типизированная схема в обе стороны
+    start = bench_seconds();
+    for (int i = 0; ok && i < iterations; i++) {
+        size_t count = 0;
+        BenchRow* rows = BenchRow_read(client, "Bench!A1:J", &count);
+        ok = rows && BenchRow_write(client, "Bench!A1", rows, count);
+        BenchRow_free(client, rows, count);
+    }
+    bench_report("typed", bench_seconds() - start, iterations);
+
+    // Локальная сортировка и top-k
+    GSheetSortKey keys[] = { { 2, GSHEET_SORT_AUTO, true }, { 1, GSHEET_SORT_TEXT, false } };
+    start = bench_seconds();
+    for (int i = 0; ok && i < iterations; i++) {
+        GSheetView* view = gsheet_view_create(data);
+        ok = view && gsheet_view_sort(view, keys, 2);
+        gsheet_view_free(view);
+        view = gsheet_view_create(data);
+        ok = ok && view && gsheet_view_top_k(view, keys, 2, 50);
+        gsheet_view_free(view);
+    }
+    bench_report("sort", bench_seconds() - start, iterations);
+
+    // Хеширование прочитанного и проверка перед записью
+    start = bench_seconds();
+    for (int i = 0; ok && i < iterations; i++) {
+        GSheetReadSet* set = gsheet_readset_create();
+        GSheetConflict conflict;
+        ok = set && gsheet_readset_add(set, "Bench!A1:J", data) &&
+             gsheet_write_range_checked(client, set, "Bench!A1", data, &conflict) == GSHEET_COMMIT_OK;
+        gsheet_conflict_clear(&conflict);
+        gsheet_readset_free(set);
+    }
+    bench_report("commit", bench_seconds() - start, iterations);
+
+    GSheetMetricsSnapshot metrics;
+    gsheet_metrics_snapshot(client, &metrics);
+    printf("requests %llu, allocations %llu, bytes in %llu, bytes out %llu\n",
+           (unsigned long long)metrics.requests, (unsigned long long)metrics.allocations,
+           (unsigned long long)metrics.bytes_in, (unsigned long long)metrics.bytes_out);
+
+    gsheet_free_range(data);
+    gsheet_free(client);
+    bench_responses_free(&responses);
+    if (!ok) fprintf(stderr, "Benchmark failed\n");
+    return ok ? 0 : 1;
+}
+
+// Выделения на запрос read_range/write_range: malloc клиента против арены,
+// сбрасываемой после каждого запроса. Число выделений одно и то же - меняется
+// их цена: с ареной это сдвиг указателя вместо обращения к куче
+static int bench_alloc_run(GSheetClient* client, GSheetArena* arena, const char* allocator_name,
+                           SheetRange* data, int iterations) {
+    const double cells = (double)data->rows * (double)data->cols;
+    int ok = 1;
+    for (int op = 0; ok && op < 2; op++) {
+        GSheetMetricsSnapshot before, after;
+        gsheet_metrics_snapshot(client, &before);
+        double start = bench_seconds();
+        for (int i = 0; ok && i < iterations; i++) {
+            if (op == 0) {
+                SheetRange* range = gsheet_read_range(client, "Bench!A1:J");
+                ok = range != NULL;
+                gsheet_free_range(range);
+            }
+            else {
+                ok = gsheet_write_range(client, "Bench!A1", data);
+            }
+            if (arena) gsheet_arena_reset(arena);
+        }
+        double seconds = bench_seconds() - start;
+        gsheet_metrics_snapshot(client, &after);
+        double per_request = (double)(after.allocations - before.allocations) / iterations;
+        printf("%-6s %-7s %14.1f %12.3f %10.3f\n", op == 0 ? "read" : "write", allocator_name,
+               per_request, per_request / cells, seconds * 1000.0 / iterations);
+    }
+    return ok;
+}
+
+static int cli_bench_alloc(int iterations) {
+    BenchResponses responses;
+    GSheetClient* client = NULL;
+    GSheetArena* arena = gsheet_arena_create(0);
+    if (!arena || !bench_responses_init(&responses, BENCH_ROWS, BENCH_COLS)) {
+        fprintf(stderr, "Cannot prepare benchmark\n");
+        gsheet_arena_destroy(arena);
+        return 1;
+    }
+    client = bench_client(&responses);
+    // Данные для записи выделены malloc и переживают сбросы арены
+    SheetRange* data = client ? gsheet_read_range(client, "Bench!A1:J") : NULL;
+    int ok = data != NULL;
+
+    if (ok) {
+        printf("%d x %d cells, %d iterations\n", BENCH_ROWS, BENCH_COLS, iterations);
+        printf("%-6s %-7s %14s %12s %10s\n", "op", "alloc", "allocs/request", "allocs/cell", "ms/iter");
+        ok = bench_alloc_run(client, NULL, "malloc", data, iterations);
+        GSheetAllocator allocator = gsheet_arena_allocator(arena);
+        gsheet_set_allocator(client, &allocator);
+        ok = ok && bench_alloc_run(client, arena, "arena", data, iterations);
+        gsheet_set_allocator(client, NULL);
+    }
+
+    gsheet_free_range(data);
+    gsheet_free(client);
+    gsheet_arena_destroy(arena);
+    bench_responses_free(&responses);
+    if (!ok) fprintf(stderr, "Benchmark failed\n");
+    return ok ? 0 : 1;
+}
+
+// Построение SheetRange на широком (1k x 100) и длинном (100k x 10) ответе.
+// Сборка линейна, поэтому ns/cell у обеих форм одного порядка: при возврате
+// к cJSON_GetArrayItem во вложенных циклах широкая форма замедлится в десятки
+// раз, а длинная - в тысячи (O(rows^2))
+static int cli_bench_sizes(int iterations) {
+    static const int shapes[][2] = { { 1000, 100 }, { 100000, 10 } };
+    int ok = 1;
+    printf("%-12s %-6s %10s %10s\n", "shape", "op", "ms/iter", "ns/cell");
+    for (size_t k = 0; ok && k < sizeof(shapes) / sizeof(shapes[0]); k++) {
+        const int rows = shapes[k][0], cols = shapes[k][1];
+        const double cells = (double)rows * cols;
+        char shape[32];
+        snprintf(shape, sizeof(shape), "%dx%d", rows, cols);
+
+        BenchResponses responses;
+        if (!bench_responses_init(&responses, rows, cols)) {
+            fprintf(stderr, "Cannot prepare benchmark\n");
+            return 1;
+        }
+        GSheetClient* client = bench_client(&responses);
+        SheetRange* data = client ? gsheet_read_range(client, "Bench!A1:ZZ") : NULL;
+        ok = data && data->rows == (size_t)rows && data->cols == (size_t)cols;
+
+        double start = bench_seconds();
+        for (int i = 0; ok && i < iterations; i++) {
+            SheetRange* range = gsheet_read_range(client, "Bench!A1:ZZ");
+            ok = range != NULL;
+            gsheet_free_range(range);
+        }
+        double seconds = bench_seconds() - start;
+        if (ok) printf("%-12s %-6s %10.3f %10.1f\n", shape, "read",
+                       seconds * 1000.0 / iterations, seconds * 1e9 / iterations / cells);
+
+        start = bench_seconds();
+        for (int i = 0; ok && i < iterations; i++) ok = gsheet_write_range(client, "Bench!A1", data);
+        seconds = bench_seconds() - start;
+        if (ok) printf("%-12s %-6s %10.3f %10.1f\n", shape, "write",
+                       seconds * 1000.0 / iterations, seconds * 1e9 / iterations / cells);
+
+        gsheet_free_range(data);
+        gsheet_free(client);
+        bench_responses_free(&responses);
+    }
+    if (!ok) fprintf(stderr, "Benchmark failed\n");
+    return ok ? 0 : 1;
+}
+
+// Пропускная способность пула задач: requests чтений через *_async, ответ
+// приходит через latency_ms, как от сервера. Стадии IO блокируют рабочие
+// потоки, поэтому req/s растёт с числом потоков, пока не упрётся в разбор
+static void bench_pool_done(SheetRange* range, void* userdata) {
+    (void)userdata;
+    gsheet_free_range(range);
+}
+
+static int cli_bench_pool(int workers, int requests, int latency_ms) {
+    static const char* stage_names[GSHEET_STAGE_COUNT] = { "build", "io", "parse", "post" };
+    BenchResponses responses;
+    if (!bench_responses_init(&responses, BENCH_POOL_ROWS, BENCH_COLS)) {
+        fprintf(stderr, "Cannot prepare benchmark\n");
+        return 1;
+    }
+    responses.latency_ms = latency_ms;
+    GSheetClient* client = bench_client(&responses);
+    GSheetPool* pool = client ? gsheet_pool_create((size_t)workers) : NULL;
+    if (!pool) {
+        fprintf(stderr, "Cannot prepare benchmark\n");
+        gsheet_free(client);
+        bench_responses_free(&responses);
+        return 1;
+    }
+    gsheet_attach_pool(client, pool);
+
+    GSheetPoolStats stats;
+    double start = bench_seconds();
+    int submitted = 0;
+    while (submitted < requests && gsheet_read_range_async(client, "Bench!A1:J", bench_pool_done, NULL)) {
+        submitted++;
+    }
+    // Запрос завершён, когда отработала его стадия POST (callback); счётчики
+    // стадии обновляются после её выполнения, поэтому ждём и пустых очередей
+    int busy;
+    do {
+        bench_sleep_ms(1);
+        gsheet_pool_stats(pool, &stats);
+        busy = stats.stages[GSHEET_STAGE_POST].completed < (uint64_t)submitted;
+        for (int s = 0; s < GSHEET_STAGE_COUNT; s++) busy = busy || stats.stages[s].queued;
+    } while (busy);
+    double seconds = bench_seconds() - start;
+
+    GSheetMetricsSnapshot metrics;
+    gsheet_metrics_snapshot(client, &metrics);
+    printf("%zu workers, %d requests of %d x %d cells, latency %d ms\n",
+           stats.workers, submitted, BENCH_POOL_ROWS, BENCH_COLS, latency_ms);
+    printf("%.1f req/s, errors %llu, steals %llu\n", submitted / seconds,
+           (unsigned long long)metrics.errors, (unsigned long long)stats.steals);
+    for (int s = 0; s < GSHEET_STAGE_COUNT; s++) {
+        const GSheetStageStats* stage = &stats.stages[s];
+        if (!stage->completed) continue;
+        printf("%-6s %8llu done, wait %8.3f ms, run %8.3f ms\n", stage_names[s],
+               (unsigned long long)stage->completed,
+               stage->wait_us / 1000.0 / stage->completed, stage->run_us / 1000.0 / stage->completed);
+    }
+
+    gsheet_attach_pool(client, NULL);
+    gsheet_pool_destroy(pool);
+    gsheet_free(client);
+    bench_responses_free(&responses);
+    if (submitted < requests || metrics.errors) {
+        fprintf(stderr, "Benchmark failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s read <access_token> <spreadsheet_id> <range>\n"
+        "  %s bench [iterations]\n"
+        "  %s bench alloc [iterations]\n"
+        "  %s bench sizes [iterations]\n"
+        "  %s bench pool <workers> [requests] [latency_ms]\n", program, program, program, program, program);
+}
+
+int main(int argc, char** argv) {
+    if (argc == 5 && strcmp(argv[1], "read") == 0) {
+        return cli_read(argv[2], argv[3], argv[4]);
+    }
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "bench") == 0 && strcmp(argv[2], "pool") == 0) {
+        int workers = atoi(argv[3]);
+        int requests = argc >= 5 ? atoi(argv[4]) : 200;
+        int latency_ms = argc == 6 ? atoi(argv[5]) : 20;
+        return cli_bench_pool(workers > 0 ? workers : 1, requests > 0 ? requests : 200,
+                              latency_ms >= 0 ? latency_ms : 20);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "bench") == 0 && strcmp(argv[2], "sizes") == 0) {
+        int iterations = argc == 4 ? atoi(argv[3]) : 5;
+        return cli_bench_sizes(iterations > 0 ? iterations : 5);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "bench") == 0 && strcmp(argv[2], "alloc") == 0) {
+        int iterations = argc == 4 ? atoi(argv[3]) : 20;
+        return cli_bench_alloc(iterations > 0 ? iterations : 20);
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "bench") == 0) {
+        int iterations = argc == 3 ? atoi(argv[2]) : 20;
+        return cli_bench(iterations > 0 ? iterations : 20);
+    }
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,234 @@
+#ifndef GSHEET_SCHEMA_H
+#define GSHEET_SCHEMA_H
+
+// Типизированные схемы листов (X-macro)
+//
+// Схема описывается списком полей в порядке столбцов:
+//
+//     #define TRADE_FIELDS(X) X(STRING, id) X(DOUBLE, amount) X(DATE, ts)
+//     GSHEET_SCHEMA(Trade, TRADE_FIELDS)
+//
+// GSHEET_SCHEMA генерирует структуру строки Trade и функции для неё:
+//     Trade* Trade_read(client, "Лист1!A2:C", &count);
+//     bool Trade_write(client, "Лист1!A2", rows, count);
+//     void Trade_free(client, rows, count);
+// Значения читаются с valueRenderOption=UNFORMATTED_VALUE и пишутся из JSON
+// ответа сразу в поля структур: без промежуточного char*** и без выбора типа
+// ячейки во время выполнения - декодер каждого поля выбирается при компиляции.
+//
+// Типы полей:
+//     STRING - char*, строка забирается из cJSON без копии; пустая ячейка - NULL
+//     DOUBLE - double; пустая или нечисловая ячейка - NAN
+//     INT    - long long; пустая - 0; дробная отбрасывает дробную часть;
+//              вне диапазона long long или текст не целым числом - GSHEET_INT_INVALID
+//              (пишется пустой ячейкой, как NAN у DOUBLE)
+//     BOOL   - int (0/1)
+//     DATE   - int64_t, секунды Unix (из серийного номера даты Google Sheets); пустая - 0
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cJSON.h>
+#include "google_sheets.h"
+
+// Тело запроса записи. После ошибки выделения памяти failed = 1 и
+// дальнейшие добавления игнорируются
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    int failed;
+} GSheetText;
+
+// Кодек строки, генерируется GSHEET_SCHEMA
+typedef struct {
+    size_t row_size;
+    void (*decode_row)(cJSON* row, void* out);
+    void (*encode_row)(GSheetText* text, const void* in);
+    void (*free_row)(void* row, void (*release)(void* ptr));
+} GSheetRowCodec;
+
+void* gsheet_read_typed(GSheetClient* client, const char* range,
+                        const GSheetRowCodec* codec, size_t* count);
+bool gsheet_write_typed(GSheetClient* client, const char* range,
+                        const GSheetRowCodec* codec, const void* rows, size_t count);
+void gsheet_free_typed(GSheetClient* client, const GSheetRowCodec* codec, void* rows, size_t count);
+
+// Служебные функции кодеков GSHEET_SCHEMA: экспортируются только для
+// сгенерированного кода, не часть API и могут меняться между версиями
+void gsheet_internal_text_append(GSheetText* text, const char* data, size_t len);
+void gsheet_internal_text_put_string(GSheetText* text, const char* value);
+void gsheet_internal_text_put_number(GSheetText* text, double value);
+void gsheet_internal_text_put_int(GSheetText* text, long long value);
+// Число в ячейке строкового поля (UNFORMATTED_VALUE отдаёт id 123 числом)
+char* gsheet_internal_cell_text(const cJSON* cell);
+
+// Серийный номер даты Google Sheets: дни от 1899-12-30; 25569 - 1970-01-01
+#define GSHEET_SERIAL_UNIX_EPOCH 25569.0
+// Значение INT-поля, которое не помещается в long long или не является числом
+#define GSHEET_INT_INVALID LLONG_MIN
+
+#define GSHEET_FIELD_TYPE_STRING char*
+#define GSHEET_FIELD_TYPE_DOUBLE double
+#define GSHEET_FIELD_TYPE_INT long long
+#define GSHEET_FIELD_TYPE_BOOL int
+#define GSHEET_FIELD_TYPE_DATE int64_t
+
+// Декодеры ячеек: cell == NULL - ячейка за концом строки (пустая)
+static inline void gsheet_decode_STRING(cJSON* cell, char** out) {
+    if (cJSON_IsString(cell)) {
+        *out = cell->valuestring;
+        cell->valuestring = NULL;
+    }
+    else {
+        *out = cJSON_IsNumber(cell) || cJSON_IsBool(cell) ? gsheet_internal_cell_text(cell) : NULL;
+    }
+}
+
+static inline void gsheet_decode_DOUBLE(cJSON* cell, double* out) {
+    char* end = NULL;
+    if (cJSON_IsNumber(cell)) {
+        *out = cell->valuedouble;
+    }
+    else if (cJSON_IsString(cell) && cell->valuestring[0]) {
+        *out = strtod(cell->valuestring, &end);
+        if (*end != '\0') *out = NAN;
+    }
+    else {
+        *out = NAN;
+    }
+}
+
+// Приведение double вне [LLONG_MIN, LLONG_MAX] к long long - UB, поэтому
+// диапазон проверяется до приведения (NAN не проходит ни одно сравнение)
+static inline void gsheet_decode_INT(cJSON* cell, long long* out) {
+    char* end = NULL;
+    if (cJSON_IsNumber(cell)) {
+        const double value = cell->valuedouble;
+        *out = value >= (double)LLONG_MIN && value < -(double)LLONG_MIN ? (long long)value : GSHEET_INT_INVALID;
+    }
+    else if (cJSON_IsString(cell) && cell->valuestring[0]) {
+        errno = 0;
+        *out = strtoll(cell->valuestring, &end, 10);
+        if (*end != '\0' || errno == ERANGE || *out == GSHEET_INT_INVALID) *out = GSHEET_INT_INVALID;
+    }
+    else {
+        *out = 0;
+    }
+}
+
+static inline void gsheet_decode_BOOL(cJSON* cell, int* out) {
+    if (cJSON_IsBool(cell)) *out = cJSON_IsTrue(cell) ? 1 : 0;
+    else if (cJSON_IsNumber(cell)) *out = cell->valuedouble != 0;
+    else if (cJSON_IsString(cell)) *out = strcmp(cell->valuestring, "TRUE") == 0 || strcmp(cell->valuestring, "true") == 0;
+    else *out = 0;
+}
+
+static inline void gsheet_decode_DATE(cJSON* cell, int64_t* out) {
+    if (cJSON_IsNumber(cell)) *out = (int64_t)llround((cell->valuedouble - GSHEET_SERIAL_UNIX_EPOCH) * 86400.0);
+    else *out = 0;
+}
+
+// Кодировщики полей; NULL, NAN и GSHEET_INT_INVALID пишутся пустой ячейкой
+static inline void gsheet_encode_STRING(GSheetText* text, const char* value) {
+    gsheet_internal_text_put_string(text, value ? value : "");
+}
+
+static inline void gsheet_encode_DOUBLE(GSheetText* text, double value) {
+    gsheet_internal_text_put_number(text, value);
+}
+
+static inline void gsheet_encode_INT(GSheetText* text, long long value) {
+    if (value == GSHEET_INT_INVALID) gsheet_internal_text_append(text, "\"\"", 2);
+    else gsheet_internal_text_put_int(text, value);
+}
+
+static inline void gsheet_encode_BOOL(GSheetText* text, int value) {
+    if (value) gsheet_internal_text_append(text, "true", 4);
+    else gsheet_internal_text_append(text, "false", 5);
+}
+
+static inline void gsheet_encode_DATE(GSheetText* text, int64_t value) {
+    gsheet_internal_text_put_number(text, (double)value / 86400.0 + GSHEET_SERIAL_UNIX_EPOCH);
+}
+
+// Освобождение полей: владеют памятью только строки
+static inline void gsheet_release_STRING(char** value, void (*release)(void*)) {
+    release(*value);
+    *value = NULL;
+}
+
+static inline void gsheet_release_DOUBLE(double* value, void (*release)(void*)) {
+    (void)value; (void)release;
+}
+
+static inline void gsheet_release_INT(long long* value, void (*release)(void*)) {
+    (void)value; (void)release;
+}
+
+static inline void gsheet_release_BOOL(int* value, void (*release)(void*)) {
+    (void)value; (void)release;
+}
+
+static inline void gsheet_release_DATE(int64_t* value, void (*release)(void*)) {
+    (void)value; (void)release;
+}
+
+#define GSHEET_SCHEMA_STRUCT_FIELD(kind, name) GSHEET_FIELD_TYPE_##kind name;
+
+#define GSHEET_SCHEMA_DECODE_FIELD(kind, name) \
+    gsheet_decode_##kind(cell, &record->name);  \
+    cell = cell ? cell->next : NULL;
+
+// После каждого поля ',' - последнюю gsheet_write_typed заменяет на ']'
+#define GSHEET_SCHEMA_ENCODE_FIELD(kind, name) \
+    gsheet_encode_##kind(text, record->name);   \
+    gsheet_internal_text_append(text, ",", 1);
+
+#define GSHEET_SCHEMA_FREE_FIELD(kind, name) gsheet_release_##kind(&record->name, release);
+
+#define GSHEET_SCHEMA(Type, FIELDS)                                                           \
+    typedef struct {                                                                          \
+        FIELDS(GSHEET_SCHEMA_STRUCT_FIELD)                                                    \
+    } Type;                                                                                   \
+                                                                                              \
+    static inline void Type##_decode_row(cJSON* row, void* out) {                             \
+        Type* record = (Type*)out;                                                            \
+        cJSON* cell = cJSON_IsArray(row) ? row->child : NULL;                                 \
+        FIELDS(GSHEET_SCHEMA_DECODE_FIELD)                                                    \
+        (void)cell;                                                                           \
+    }                                                                                         \
+                                                                                              \
+    static inline void Type##_encode_row(GSheetText* text, const void* in) {                  \
+        const Type* record = (const Type*)in;                                                 \
+        FIELDS(GSHEET_SCHEMA_ENCODE_FIELD)                                                    \
+    }                                                                                         \
+                                                                                              \
+    static inline void Type##_free_row(void* row, void (*release)(void*)) {                   \
+        Type* record = (Type*)row;                                                            \
+        FIELDS(GSHEET_SCHEMA_FREE_FIELD)                                                      \
+        (void)record; (void)release;                                                          \
+    }                                                                                         \
+                                                                                              \
+    static const GSheetRowCodec Type##_codec = {                                              \
+        sizeof(Type), Type##_decode_row, Type##_encode_row, Type##_free_row                   \
+    };                                                                                        \
+                                                                                              \
+    static inline Type* Type##_read(GSheetClient* client, const char* range, size_t* count) { \
+        return (Type*)gsheet_read_typed(client, range, &Type##_codec, count);                 \
+    }                                                                                         \
+                                                                                              \
+    static inline bool Type##_write(GSheetClient* client, const char* range,                  \
+                                    const Type* rows, size_t count) {                         \
+        return gsheet_write_typed(client, range, &Type##_codec, rows, count);                 \
+    }                                                                                         \
+                                                                                              \
+    static inline void Type##_free(GSheetClient* client, Type* rows, size_t count) {          \
+        gsheet_free_typed(client, &Type##_codec, rows, count);                                \
+    }
+
+#endif // GSHEET_SCHEMA_H
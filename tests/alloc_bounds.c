@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "google_sheets.h"
+#include "gsheet_schema.h"
+
+// Границы выделений и копирований на горячих путях разбора и сборки JSON.
+// Запросы идут через подменный транспорт, счётчики - из gsheet_metrics_snapshot.
+// Тест падает, если переработка этих путей вернёт выделения на каждую ячейку
+// или лишние копии тела запроса
+
+#define TEST_ROWS 2000
+#define TEST_COLS 10
+
+// Сейчас ~2.1 на ячейку: узел cJSON и его строка, которую SheetRange забирает
+// без копии. Ещё одно выделение на ячейку даст > 3
+#define MAX_READ_ALLOCS_PER_CELL 2.5
+#define MAX_WRITE_ALLOCS_PER_CELL 2.5
+// Типизированное чтение: узел cJSON на ячейку плюс строки строковых полей
+#define MAX_TYPED_READ_ALLOCS_PER_CELL 1.5
+// Типизированная запись собирает тело в один растущий буфер
+#define MAX_TYPED_WRITE_ALLOCS_PER_REQUEST 64
+
+typedef struct {
+    char* values;           // ответ GET values
+    size_t values_len;
+} TestTransport;
+
+static int failures = 0;
+
+static void check(int condition, const char* what, double actual, double bound) {
+    printf("%-36s %12.3f  (bound %.3f)  %s\n", what, actual, bound, condition ? "ok" : "FAILED");
+    if (!condition) failures++;
+}
+
+static long test_handler(void* user, const char* method, const char* url,
+                         const char* payload, const char** response, size_t* response_len) {
+    TestTransport* transport = user;
+    (void)url;
+    (void)payload;
+    if (strcmp(method, "GET") == 0) {
+        *response = transport->values;
+        *response_len = transport->values_len;
+    }
+    else {
+        *response = "{}";
+        *response_len = 2;
+    }
+    return 200;
+}
+
+// Сетка TEST_ROWS x TEST_COLS: строки, числа, дата, флаг - как у схемы TestRow
+static char* test_values_json(size_t* len) {
+    const size_t cap = (size_t)TEST_ROWS * TEST_COLS * 24 + 256;
+    char* json = malloc(cap);
+    if (!json) return NULL;
+    size_t pos = (size_t)snprintf(json, cap, "{\"range\":\"Test!A1:J%d\",\"values\":[", TEST_ROWS);
+    for (int i = 0; i < TEST_ROWS; i++) {
+        pos += (size_t)snprintf(json + pos, cap - pos, "%s[\"id%d\",\"name %d\"", i ? "," : "", i, i % 97);
+        for (int j = 2; j < TEST_COLS - 2; j++) {
+            pos += (size_t)snprintf(json + pos, cap - pos, ",%d.25", (i * 31 + j * 7) % 1000);
+        }
+        pos += (size_t)snprintf(json + pos, cap - pos, ",%d.5,%s]", 45000 + i % 365, i % 3 ? "true" : "false");
+    }
+    pos += (size_t)snprintf(json + pos, cap - pos, "]}");
+    *len = pos;
+    return json;
+}
+
+#define TEST_FIELDS(X) \
+    X(STRING, id)      \
+    X(STRING, name)    \
+    X(DOUBLE, c)       \
+    X(DOUBLE, d)       \
+    X(DOUBLE, e)       \
+    X(DOUBLE, f)       \
+    X(DOUBLE, g)       \
+    X(DOUBLE, h)       \
+    X(DATE, ts)        \
+    X(BOOL, flag)
+GSHEET_SCHEMA(TestRow, TEST_FIELDS)
+
+int main(void) {
+    TestTransport transport = { NULL, 0 };
+    transport.values = test_values_json(&transport.values_len);
+    GSheetClient* client = gsheet_init("test", "test");
+    if (!transport.values || !client || !gsheet_set_mock_transport(client, test_handler, &transport)) {
+        fprintf(stderr, "Cannot prepare test\n");
+        gsheet_free(client);
+        free(transport.values);
+        return 1;
+    }
+    const double cells = (double)TEST_ROWS * TEST_COLS;
+    GSheetMetricsSnapshot before, after;
+
+    // JSON -> SheetRange
+    gsheet_metrics_snapshot(client, &before);
+    SheetRange* data = gsheet_read_range(client, "Test!A1:J");
+    gsheet_metrics_snapshot(client, &after);
+    if (!data || data->rows != TEST_ROWS || data->cols != TEST_COLS) {
+        fprintf(stderr, "read_range returned wrong shape\n");
+        gsheet_free_range(data);
+        gsheet_free(client);
+        free(transport.values);
+        return 1;
+    }
+    check((after.allocations - before.allocations) / cells <= MAX_READ_ALLOCS_PER_CELL,
+          "read_range allocations per cell", (after.allocations - before.allocations) / cells,
+          MAX_READ_ALLOCS_PER_CELL);
+    // Тело ответа копируется один раз - в буфер соединения
+    check(after.bytes_in - before.bytes_in == transport.values_len,
+          "read_range bytes in per request", (double)(after.bytes_in - before.bytes_in),
+          (double)transport.values_len);
+
+    // SheetRange -> JSON
+    size_t text_bytes = 0;
+    for (size_t i = 0; i < data->rows; i++) {
+        for (size_t j = 0; j < data->cols; j++) text_bytes += strlen(data->data[i][j]);
+    }
+    // Кавычки и запятая на ячейку, скобки и запятая на строку, обёртка
+    const double payload_bound = (double)text_bytes + 3 * cells + 3.0 * TEST_ROWS + 16;
+    gsheet_metrics_snapshot(client, &before);
+    int ok = gsheet_write_range(client, "Test!A1", data);
+    gsheet_metrics_snapshot(client, &after);
+    if (!ok) {
+        fprintf(stderr, "write_range failed\n");
+        failures++;
+    }
+    check((after.allocations - before.allocations) / cells <= MAX_WRITE_ALLOCS_PER_CELL,
+          "write_range allocations per cell", (after.allocations - before.allocations) / cells,
+          MAX_WRITE_ALLOCS_PER_CELL);
+    check(after.bytes_out - before.bytes_out <= payload_bound,
+          "write_range bytes out per request", (double)(after.bytes_out - before.bytes_out), payload_bound);
+
+    // Типизированная схема
+    size_t count = 0;
+    gsheet_metrics_snapshot(client, &before);
+    TestRow* rows = TestRow_read(client, "Test!A1:J", &count);
+    gsheet_metrics_snapshot(client, &after);
+    if (!rows || count != TEST_ROWS) {
+        fprintf(stderr, "typed read returned %zu rows\n", count);
+        failures++;
+    }
+    check((after.allocations - before.allocations) / cells <= MAX_TYPED_READ_ALLOCS_PER_CELL,
+          "typed read allocations per cell", (after.allocations - before.allocations) / cells,
+          MAX_TYPED_READ_ALLOCS_PER_CELL);
+
+    gsheet_metrics_snapshot(client, &before);
+    ok = rows && TestRow_write(client, "Test!A1", rows, count);
+    gsheet_metrics_snapshot(client, &after);
+    if (!ok) {
+        fprintf(stderr, "typed write failed\n");
+        failures++;
+    }
+    check(after.allocations - before.allocations <= MAX_TYPED_WRITE_ALLOCS_PER_REQUEST,
+          "typed write allocations per request", (double)(after.allocations - before.allocations),
+          MAX_TYPED_WRITE_ALLOCS_PER_REQUEST);
+    check(after.bytes_out - before.bytes_out <= payload_bound,
+          "typed write bytes out per request", (double)(after.bytes_out - before.bytes_out), payload_bound);
+
+    TestRow_free(client, rows, count);
+    gsheet_free_range(data);
+    gsheet_free(client);
+    free(transport.values);
+    if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}